@@ -46,43 +46,644 @@ extern "C" {
 #include <string.h>
 #include <stdlib.h>
 #include <stdint.h>
+
+// c++ (before 23) has no _Atomic, and only ever touches these structs through
+// the c api anyway, so it gets their layout without the qualifier... the
+// implementation itself always has to be built as c
+#ifdef __cplusplus
+#define __ARC_ATOMIC(T) alignas(sizeof(T)) T
+#else
 #include <stdatomic.h>
+#define __ARC_ATOMIC(T) _Atomic T
+#endif // __cplusplus
+
+// ARC_COMPACT_COUNTS halves the counts to 32 bits, so the whole header fits
+// in 8 bytes instead of 16... for heaps full of tiny arcs, where the header
+// outweighs the data, at the cost of a ~1 billion ref ceiling. ARC_PACKED_COUNTS
+// goes further still and shares one word between them (more on that below)
+#if defined(ARC_COMPACT_COUNTS) || defined(ARC_PACKED_COUNTS)
+typedef uint32_t __arc_count_t;
+#else
+typedef size_t __arc_count_t;
+#endif // ARC_COMPACT_COUNTS || ARC_PACKED_COUNTS
+
+#ifdef ARC_PACKED_COUNTS
+typedef uint64_t __arc_word_t;
+
+#define __ARC_DEFINE_HEADER(name, word_t) \
+  typedef struct name { \
+    word_t counts; \
+  } name##_t;
+#else
+typedef __arc_count_t __arc_word_t;
+
+#define __ARC_DEFINE_HEADER(name, word_t) \
+  typedef struct name { \
+    word_t weak_count; \
+    word_t strong_count; \
+  } name##_t;
+#endif // ARC_PACKED_COUNTS
+
+/// The counts (and bookkeeping) in front of every arc's data, treat it as
+/// opaque... embed one as ARC_INTRUSIVE_HEADER to count refs to a struct you
+/// allocate yourself, without arc_new ever owning the memory
+__ARC_DEFINE_HEADER(arc_header, __ARC_ATOMIC(__arc_word_t))
+
+#define ARC_INTRUSIVE_HEADER arc_header_t arc_header
+
+/// Allocator an arc's block is obtained from and returned to
+typedef struct arc_allocator {
+  /// Return at least nbytes suitably aligned for any type, or NULL
+  void *(*alloc)(void *ctx, size_t nbytes);
+  /// Return a block previously handed out by alloc
+  void (*free)(void *ctx, void *ptr);
+  /// Passed through untouched to alloc and free
+  void *ctx;
+  /// Optionally resize a block from alloc keeping its contents (like realloc),
+  /// or NULL to have arc_realloc move it by hand
+  void *(*realloc)(void *ctx, void *ptr, size_t nbytes);
+} arc_allocator_t;
+
+/// Install the allocator used by arc_new (NULL restores malloc/free), call
+/// once at startup before any arc is created
+void arc_set_allocator(const arc_allocator_t *allocator);
+
+#ifndef ARC_CACHE_LINE_SIZE
+#define ARC_CACHE_LINE_SIZE ((size_t) 64)
+#endif // ARC_CACHE_LINE_SIZE
 
 /// Create a new strong arc pointing to data
 void *arc_new(size_t nbytes);
-/// Run a destructor for data when strong count is zero
+/// Create a new strong arc whose data starts out zeroed (by calloc, where it
+/// can, so large arcs get the kernel's zero pages instead of a memset)
+void *arc_new_zeroed(size_t nbytes);
+/// Create a new strong arc holding a copy of the nbytes at src
+void *arc_from_copy(const void *src, size_t nbytes);
+/// Create a new strong arc with room for count elements of elem_size bytes,
+/// failing with ENOMEM when that doesn't fit in a size_t
+void *arc_new_array(size_t count, size_t elem_size);
+/// Create a new strong array arc (as above) that runs elem_destructor on each
+/// element in turn once the last strong goes, given a NULL destructor
+void *arc_new_array_with_dtor(size_t count, size_t elem_size, void(*elem_destructor)(void *));
+/// Return the element count of an arc from arc_new_array(_with_dtor), else 0
+size_t arc_array_len(void *arc_data);
+/// How arc_new_mapped should back an arc, or'd together
+typedef enum arc_map_flags {
+  /// Ask for explicit huge pages (MAP_HUGETLB), falling back to ARC_MAP_THP
+  /// when there are none reserved
+  ARC_MAP_HUGETLB = 1 << 0,
+  /// Ask for transparent huge pages with madvise(MADV_HUGEPAGE)
+  ARC_MAP_THP = 1 << 1,
+  /// Fault every page in up front (MAP_POPULATE) rather than on first touch
+  ARC_MAP_POPULATE = 1 << 2,
+} arc_map_flags_t;
+
+/// Create a new strong arc in its own mapping, unmapped by the last weak
+/// (arc_new does this by itself from ARC_MAP_THRESHOLD bytes up)
+void *arc_new_mapped(size_t nbytes, unsigned flags);
+/// Create a new strong arc whose data is the file at path mapped read-only
+/// (and so never unique to arc_get_mut), storing its size in nbytes if
+/// non-NULL, or return NULL and errno
+void *arc_map_file(const char *path, size_t *nbytes);
+/// Pass as a node to place memory on whichever node the calling thread is
+/// running on at the time
+#define ARC_NODE_LOCAL (-1)
+
+/// An allocator placing blocks on NUMA node (or ARC_NODE_LOCAL), for
+/// arc_new_in or arc_set_allocator, or NULL and EINVAL past ARC_MAX_NODES...
+/// small blocks share slabs bound to the node once, bigger ones get whole
+/// pages of their own, and either way placement is best effort, so memory
+/// the kernel won't bind stays wherever it lands (see arc_node_of)
+const arc_allocator_t *arc_node_allocator(int node);
+/// Create a new strong arc with its header and data placed on NUMA node (or
+/// ARC_NODE_LOCAL), best effort where the kernel doesn't do NUMA
+void *arc_new_on_node(size_t nbytes, int node);
+/// Return the NUMA node arc_data's data sits on, or -1 and errno
+int arc_node_of(void *arc_data);
+/// Return the NUMA node the calling thread is running on, or -1 and errno
+int arc_current_node(void);
+/// Create a new strong arc whose data is aligned to align (a power of two)
+void *arc_new_aligned(size_t nbytes, size_t align);
+/// Create a new strong arc whose header sits alone on the cache line before
+/// its (cache line aligned) data, so count traffic never touches the data
+void *arc_new_isolated(size_t nbytes);
+/// Create a new strong arc whose block comes from (and returns to) allocator
+void *arc_new_in(const arc_allocator_t *allocator, size_t nbytes);
+/// Create a new strong arc that remembers its destructor, so arc_free (and
+/// friends) can be handed NULL and still run it
+void *arc_new_with_dtor(size_t nbytes, void(*destructor)(void *));
+/// Create a new strong arc biased towards the calling thread, whose clones
+/// and frees on that thread skip atomics entirely
+void *arc_new_biased(size_t nbytes);
+/// Merge biased arcs other threads have dropped refs to back into their
+/// shared counts, call every so often from any thread that owns biased arcs
+/// (an exiting owner does one last poll on its own, and hands the rest of
+/// its arcs over to whichever threads drop them)
+void arc_biased_poll(void);
+/// Create a new strong arc whose count is spread over ARC_SHARDS cache lines,
+/// so threads cloning and freeing it all at once stop fighting over one line
+/// (costs a few KB per arc, and it only reports unique to arc_get_mut once
+/// its count has been folded back into one, which waits until a free can't
+/// find the refs it drops on any of the shards)
+void *arc_new_sharded(size_t nbytes);
+/// Return the size arc_data was created with, if the arc recorded it (those
+/// from arc_new_in, arc_new_biased, arc_new_sharded, arc_new_traced,
+/// arc_new_array, the mapped ones and arc_new_with_dtor do), otherwise 0
+size_t arc_size(void *arc_data);
+/// Run a destructor for data when strong count is zero (NULL runs the one
+/// recorded at creation, if any)
 void arc_free(void *arc_data, void(*destructor)(void *));
+/// Drop n strong refs at once, a single decrement no matter how big n is
+void arc_free_n(void *arc_data, size_t n, void(*destructor)(void *));
+/// Drop count strong refs (reordering arcs), one decrement per distinct arc
+void arc_free_many(void **arcs, size_t count, void(*destructor)(void *));
+/// Like arc_free, but if this was the last strong the destructor (and the
+/// free) gets queued for the reclaimer rather than run here and now
+void arc_free_deferred(void *arc_data, void(*destructor)(void *));
 /// Clone a strong arc, incrementing strong count
 void *arc_clone(void *arc_data);
+/// Clone a strong arc n times over, a single increment no matter how big n is
+void *arc_clone_n(void *arc_data, size_t n);
 /// Downgrade a strong into a weak, incrementing weak count
 void *arc_downgrade(void *arc_data);
+/// Return arc_data if ours is the only strong and no weaks are out there,
+/// so it is safe to write to, otherwise NULL
+void *arc_get_mut(void *arc_data);
+/// Return arc_data if arc_get_mut would, otherwise copy its nbytes (0 for the
+/// recorded size) into a fresh arc with copy (NULL for memcpy), dropping our
+/// ref to the original, and return that... NULL and errno if we couldn't
+void *arc_make_mut(void *arc_data, size_t nbytes, void(*copy)(void *dst, const void *src), void(*destructor)(void *));
+/// Move the nbytes (0 for the recorded size) of a unique arc's data into out
+/// and free the arc without running any destructor, returning 0... or -1 and
+/// EBUSY if somebody else still holds a ref (EINVAL for 0 when no size was
+/// recorded), leaving the arc untouched
+int arc_try_unwrap(void *arc_data, void *out, size_t nbytes);
+/// Resize a unique arc's data to nbytes in place where the allocator allows,
+/// returning the (possibly moved) data, or NULL and errno (EBUSY if shared,
+/// EINVAL for over-aligned arcs) with the arc left untouched... while borrow
+/// guards are open the data is always copied, and EBUSY also covers arcs
+/// without a recorded size
+void *arc_realloc(void *arc_data, size_t nbytes);
+/// Make arc_data (which we hold a strong to) live forever, so every clone,
+/// free, downgrade, weak_clone and upgrade from then on is a relaxed load and
+/// nothing else... returns arc_data, or NULL and EINVAL for biased, sharded
+/// and traced arcs, which keep their counts elsewhere
+void *arc_make_immortal(void *arc_data);
+/// Return 1 if arc_data is immortal (including any ARC_OVERFLOW_SATURATE
+/// stuck at the max), otherwise 0
+int arc_is_immortal(void *arc_data);
 
 /// Free the allocation if there are no more outstanding strong arcs
 void weak_free(void *weak_data);
+/// Drop n weak refs at once
+void weak_free_n(void *weak_data, size_t n);
 /// Clone a weak, increment weak count, returning new weak
 void *weak_clone(void *weak_data);
+/// Clone a weak n times over, adding n to weak count at once
+void *weak_clone_n(void *weak_data, size_t n);
 /// Upgrade a weak, incrementing the strong count and producing a strong arc
 void *weak_upgrade(void *weak_data);
 
+/// A slot holding one strong arc (or NULL) that any number of threads can
+/// load from while others replace it, no lock needed... zero initialise it
+/// (or arc_atomic_init it) before use, and store NULL to drop what's left...
+/// an arc going in takes the refs the slot keeps for readers along with it,
+/// so putting one there fails with ETOOMANYREFS (the slot left as it was,
+/// the arc still the caller's) when its count hasn't room for them, or with
+/// EINVAL for an address using bits the slot keeps for itself (anything past
+/// 48 on 64-bit targets, say a tagged pointer or 5-level paging)
+typedef struct arc_atomic {
+  // the arc's address with a count of readers mid-load packed in up top
+  __ARC_ATOMIC(uint64_t) word;
+} arc_atomic_t;
+
+/// Initialise a slot, taking over the strong ref to arc_data (may be NULL),
+/// returning 0, or -1 and errno with the slot left empty
+int arc_atomic_init(arc_atomic_t *cell, void *arc_data);
+/// Return a new strong ref to whatever the slot currently holds, or NULL (and
+/// ETOOMANYREFS should its count be full)
+void *arc_atomic_load(arc_atomic_t *cell);
+/// Replace the slot's arc with arc_data (taking over its ref), dropping the
+/// old, returning 0, or -1 and errno
+int arc_atomic_store(arc_atomic_t *cell, void *arc_data, void(*destructor)(void *));
+/// Replace the slot's arc with arc_data (taking over its ref), returning the
+/// old one, whose ref now belongs to the caller... or NULL and errno (clear
+/// errno first to tell that from an empty slot)
+void *arc_atomic_swap(arc_atomic_t *cell, void *arc_data);
+/// Replace the slot's arc with desired only if it still holds expected,
+/// returning 1 (and dropping the slot's ref to expected), 0 if it did not, or
+/// -1 and errno, in which case desired is left with the caller
+int arc_atomic_compare_exchange(arc_atomic_t *cell, void *expected, void *desired, void(*destructor)(void *));
+
+/// Enter a borrow guard (they nest), inside which arcs reachable from a live
+/// owner can be read without taking a ref of our own... while any thread is
+/// in one, a last strong dropped anywhere leaves its destruction (and free)
+/// until every guard that might still see it has ended. Only the outermost
+/// guard costs anything (a shared increment, and a decrement at its end),
+/// though until the process takes its first one last drops skip the fence
+/// they otherwise need... that first one has the kernel fence every other
+/// thread instead (membarrier), and without it last drops keep their fence
+/// from then on, as they always do if ARC_BORROW_FENCE is defined. Returns
+/// 0, or -1 and errno
+int arc_borrow_begin(void);
+/// Leave the innermost guard, after which nothing borrowed in it may be used
+void arc_borrow_end(void);
+/// Read the slot's arc without a ref, good until the guard around us ends
+void *arc_atomic_borrow(arc_atomic_t *cell);
+/// Destroy every last-dropped arc no guard can see anymore, returning how
+/// many went (it happens by itself every ARC_BORROW_BATCH drops per thread)
+size_t arc_borrow_collect(void);
+
+/// Format size bytes at base (a MAP_SHARED mapping, say, 16 byte aligned) as a
+/// region that arcs can live in and be shared between processes through,
+/// returning 0 or -1 and errno... do it once, before any process uses it
+int arc_shm_init(void *base, size_t size);
+/// Create a new strong arc in the region at base, which every other arc
+/// function then works on as usual from any process that maps the region
+void *arc_shm_new(void *base, size_t nbytes);
+/// Where arc_data sits in the region at base, for passing it to a process
+/// that mapped the region somewhere else (the ref goes along with it)
+uint64_t arc_shm_offset(void *base, void *arc_data);
+/// The arc at offset in the region at base, as mapped by this process
+void *arc_shm_at(void *base, uint64_t offset);
+
+/// A view of len bytes at offset into an arc's data, holding a strong ref to
+/// the whole arc so that views (and views of views) never copy anything
+typedef struct arc_bytes {
+  arc_header_t *header;
+  size_t offset;
+  size_t len;
+} arc_bytes_t;
+
+/// View all len bytes of arc_data, taking over the strong ref passed in
+arc_bytes_t arc_bytes_from(void *arc_data, size_t len);
+/// Where the viewed bytes start
+uint8_t *arc_bytes_data(arc_bytes_t bytes);
+/// A new view of [begin, end) within bytes, sharing its arc (a NULL header
+/// and errno if out of range, or the clone failed)
+arc_bytes_t arc_bytes_slice(arc_bytes_t bytes, size_t begin, size_t end);
+/// Split off and return [0, at), leaving bytes viewing [at, len)
+arc_bytes_t arc_bytes_split_to(arc_bytes_t *bytes, size_t at);
+/// Split off and return [at, len), leaving bytes viewing [0, at)
+arc_bytes_t arc_bytes_split_off(arc_bytes_t *bytes, size_t at);
+/// Drop the view's strong ref (running any recorded destructor if it was
+/// the last) and empty it
+void arc_bytes_free(arc_bytes_t *bytes);
+
+/// A table deduplicating immutable byte strings (or schemas, or anything
+/// compared bytewise) into shared arcs, holding only weaks so that an entry
+/// never keeps its arc alive... it drops out of the table with its last strong
+typedef struct arc_intern arc_intern_t;
+
+/// Create an empty table, or NULL and errno
+arc_intern_t *arc_intern_new(void);
+/// Return a strong ref to the table's arc holding the nbytes at bytes, making
+/// (and adding) one if there isn't a live one yet, or NULL and errno
+void *arc_intern(arc_intern_t *table, const void *bytes, size_t nbytes);
+/// Return a strong ref to the table's live arc holding the nbytes at bytes,
+/// or NULL and ENOENT (never adding anything)
+void *arc_intern_find(arc_intern_t *table, const void *bytes, size_t nbytes);
+/// Return how many entries the table holds right now
+size_t arc_intern_count(arc_intern_t *table);
+/// Drop every entry whose arc is dead but not yet forgotten, returning how
+/// many went (the last free of an arc normally does this itself)
+size_t arc_intern_prune(arc_intern_t *table);
+/// Drop our ref to the table... what it handed out stays valid, and the table
+/// itself lingers until the last of those goes
+void arc_intern_free(arc_intern_t *table);
+
+/// A bounded multi-producer multi-consumer queue that strong refs move
+/// through, sent by giving up a ref and received by taking it over, so no
+/// count is ever touched on the way
+typedef struct arc_channel arc_channel_t;
+
+/// How arc_channel_new should set a channel up, or'd together
+typedef enum arc_channel_flags {
+  /// Sends wait (on a futex) while full and receives while empty, rather than
+  /// failing with EAGAIN... costs non-blocking sends and receives a fence
+  ARC_CHANNEL_BLOCKING = 1 << 0,
+} arc_channel_flags_t;
+
+/// Create a channel room for capacity arcs (rounded up to a power of two),
+/// or NULL and errno
+arc_channel_t *arc_channel_new(size_t capacity, unsigned flags);
+/// Send arc_data along with our strong ref to it, returning 0, or -1 and
+/// EAGAIN when full (non-blocking) or EPIPE once closed, the ref still ours
+int arc_channel_send(arc_channel_t *channel, void *arc_data);
+/// Send as many of the count arcs at arcs (in order) as there's room for,
+/// returning how many went... blocking channels wait for room for at least
+/// one, and anything unsent is still ours
+size_t arc_channel_send_n(arc_channel_t *channel, void **arcs, size_t count);
+/// Receive the oldest arc along with its ref, or NULL and EAGAIN when empty
+/// (non-blocking) or EPIPE once closed and drained
+void *arc_channel_recv(arc_channel_t *channel);
+/// Receive up to max arcs into arcs (oldest first), returning how many came,
+/// blocking channels waiting for at least one
+size_t arc_channel_recv_n(arc_channel_t *channel, void **arcs, size_t max);
+/// Stop any more sends (EPIPE), letting receivers drain what's left and
+/// waking everyone waiting
+void arc_channel_close(arc_channel_t *channel);
+/// Free the channel once nobody is using it, dropping any arcs still in it
+/// with destructor
+void arc_channel_free(arc_channel_t *channel, void(*destructor)(void *));
+
+/// Handed to a trace, to be called with every arc its data holds a strong to
+typedef void(*arc_visit_fn)(void *child, void *ctx);
+/// Report each strong arc_data's data holds by passing it to visit along with
+/// ctx (untraced arcs are ignored)... the collector may call this while other
+/// threads use the data, so read those fields as anything else racing them
+/// would, and only change them while holding a strong to arc_data
+typedef void(*arc_trace_fn)(void *arc_data, arc_visit_fn visit, void *ctx);
+
+/// Create a new strong arc the cycle collector can reclaim once only a cycle
+/// holds it up, with trace reporting the refs its data holds and destructor
+/// (recorded, as with arc_new_with_dtor) dropping them... traced arcs can't
+/// be downgraded or made immortal (EINVAL), since a weak is just the thing
+/// that could bring a dead cycle back, and only look unique to arc_get_mut
+/// once the collector has had a look at them
+void *arc_new_traced(size_t nbytes, arc_trace_fn trace, void(*destructor)(void *));
+/// Trial-delete from up to budget (0 for all) of the traced arcs that lost a
+/// ref since they were last looked at, destroying every cycle nothing else
+/// holds onto and returning how many arcs went
+size_t arc_collect_cycles(size_t budget);
+/// Start a thread calling arc_collect_cycles(budget) every interval_us (0
+/// picks 10ms), returning 0, or -1 and errno (EALREADY if one is running)
+int arc_collector_start(unsigned interval_us, size_t budget);
+/// Stop the collector thread (if any), leaving its candidates for the next
+/// arc_collect_cycles
+void arc_collector_stop(void);
+
+/// Start an embedded header off holding the one strong ref
+void arc_intrusive_init(arc_header_t *header);
+/// Take another strong ref, returning header (or NULL and errno on overflow)
+arc_header_t *arc_intrusive_clone(arc_header_t *header);
+/// Drop a strong ref, calling release (to free the struct around header,
+/// say) once it was the last
+void arc_intrusive_release(arc_header_t *header, void(*release)(arc_header_t *));
+
+/// How the queue behind arc_free_deferred gets drained
+typedef enum arc_reclaim_mode {
+  /// Nothing runs on its own, call arc_reclaimer_drain from wherever suits
+  ARC_RECLAIM_INLINE,
+  /// A dedicated thread drains the queue every interval_us
+  ARC_RECLAIM_THREAD,
+} arc_reclaim_mode_t;
+
+typedef struct arc_reclaimer_opts {
+  arc_reclaim_mode_t mode;
+  /// How long the reclaimer thread sleeps between drains, 0 picks 1ms
+  unsigned interval_us;
+  /// Most destructors run per drain, 0 for no limit
+  size_t batch;
+} arc_reclaimer_opts_t;
+
+/// Start reclaiming (NULL opts drains inline), returning 0 or -1 and errno
+int arc_reclaimer_start(const arc_reclaimer_opts_t *opts);
+/// Run queued destruction (up to the configured batch), returning how many ran
+size_t arc_reclaimer_drain(void);
+/// Stop the reclaimer thread (if any) and run everything still queued
+void arc_reclaimer_stop(void);
+
+/// Process-wide totals kept by ARC_STATS builds, summed over every thread
+typedef struct arc_stats {
+  uint64_t allocations;
+  uint64_t frees;
+  /// Data bytes asked for by arcs that haven't been freed yet
+  uint64_t live_bytes;
+  /// The same three for the rc family, which the ones above leave out
+  uint64_t rc_allocations;
+  uint64_t rc_frees;
+  uint64_t rc_live_bytes;
+  /// Calls to arc_clone/arc_downgrade/weak_upgrade (and their _n forms)
+  uint64_t clones;
+  uint64_t downgrades;
+  uint64_t upgrades;
+  /// Upgrades that found the arc already gone
+  uint64_t upgrade_failures;
+  /// How many times each CAS loop had to go round again
+  uint64_t clone_retries;
+  uint64_t weak_clone_retries;
+  uint64_t downgrade_retries;
+  uint64_t upgrade_retries;
+} arc_stats_t;
+
+/// Fill stats with the totals so far, returning 0, or -1 and ENOTSUP in
+/// builds without ARC_STATS
+int arc_stats_snapshot(arc_stats_t *stats);
+
+/// How many return addresses a sampled allocation keeps
+#ifndef ARC_SAMPLE_DEPTH
+#define ARC_SAMPLE_DEPTH 16
+#endif // ARC_SAMPLE_DEPTH
+
+/// One sampled allocation, as copied out by arc_sample_dump
+typedef struct arc_sample {
+  /// Where the data was (already dangling once the arc is gone)
+  void *arc_data;
+  size_t nbytes;
+  /// How long the arc lived, or has been alive for so far when live is set
+  uint64_t lifetime_ns;
+  int live;
+  size_t depth;
+  /// Return addresses at the allocation, innermost first
+  void *stack[ARC_SAMPLE_DEPTH];
+} arc_sample_t;
+
+/// Sample one in every allocations (0 stops sampling) in ARC_SAMPLING builds,
+/// returning 0, or -1 and ENOTSUP in builds without it
+int arc_sample_every(size_t every);
+/// Copy up to max of the most recent samples into samples, returning how many
+size_t arc_sample_dump(arc_sample_t *samples, size_t max);
+
+/// The rc family mirrors the arc family for data that never leaves the
+/// thread that made it, with plain (non-atomic) counts...
+/// Create a new strong rc pointing to data
+void *rc_new(size_t nbytes);
+/// Run a destructor for data when strong count is zero
+void rc_free(void *rc_data, void(*destructor)(void *));
+/// Drop n strong refs at once
+void rc_free_n(void *rc_data, size_t n, void(*destructor)(void *));
+/// Clone a strong rc, incrementing strong count
+void *rc_clone(void *rc_data);
+/// Clone a strong rc n times over
+void *rc_clone_n(void *rc_data, size_t n);
+/// Downgrade a strong into a weak, incrementing weak count
+void *rc_downgrade(void *rc_data);
+/// Return rc_data if it is the only strong and no weaks are out there
+void *rc_get_mut(void *rc_data);
+
+/// Free the allocation if there are no more outstanding strong rcs
+void weak_rc_free(void *weak_data);
+/// Drop n weak refs at once
+void weak_rc_free_n(void *weak_data, size_t n);
+/// Clone a weak, increment weak count, returning new weak
+void *weak_rc_clone(void *weak_data);
+/// Clone a weak n times over
+void *weak_rc_clone_n(void *weak_data, size_t n);
+/// Upgrade a weak, incrementing the strong count and producing a strong rc
+void *weak_rc_upgrade(void *weak_data);
+
 #endif // ARC_H
 
 #ifdef ARC_IMPLEMENTATION
 
-// this represents the header for a reference counted fat pointer
+#ifdef __cplusplus
+#error "ARC_IMPLEMENTATION has to be compiled as c, c++ just includes arc.hpp"
+#endif // __cplusplus
+
+#include <assert.h>
+#include <time.h>
+#include <sched.h>
+#include <limits.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+
+#if defined(ARC_COMPACT_COUNTS) || defined(ARC_PACKED_COUNTS)
+static const __arc_count_t __ARC_COUNT_MAX = UINT32_MAX;
+#else
+static const __arc_count_t __ARC_COUNT_MAX = SIZE_MAX;
+#endif // ARC_COMPACT_COUNTS || ARC_PACKED_COUNTS
+
+// ARC_PACKED_COUNTS goes one further and packs both (32 bit) counts into a
+// single 64 bit word, strong in the low half and weak in the high... a drop
+// then sees both counts at once, so an arc that was never downgraded dies in
+// a single rmw, the weak side noticing it has the word all to itself.
+// everything touches the counts through __ARC_STRONG/__ARC_WEAK (the word a
+// count lives in) and its shift, so both layouts share the one protocol
+#ifdef ARC_PACKED_COUNTS
+#define __ARC_STRONG(header) (&(header)->counts)
+#define __ARC_WEAK(header) (&(header)->counts)
+#define __ARC_STRONG_SHIFT 0
+#define __ARC_WEAK_SHIFT 33
+#define __ARC_INIT_COUNTS(OPS, header) \
+  OPS##_STORE(&(header)->counts, __ARC_UNIT(__ARC_STRONG_SHIFT) | __ARC_UNIT(__ARC_WEAK_SHIFT), memory_order_relaxed)
+// with no strongs left and every weak ours, nobody else can reach the word
+// to change it, so the last weak can skip the decrement... acquire pairs with
+// the release drops before it, same as the fence would
+#define __ARC_LONE_WEAK(OPS, header, n) \
+  ((OPS##_LOAD(&(header)->counts, memory_order_acquire) & ~__ARC_PREFIXED) == (__arc_word_t)(n) << __ARC_WEAK_SHIFT)
+// one strong and one weak, read in one go... acquire for the same reason as
+// the last drop, whoever let go before us must be done with the data
+#define __ARC_DEFINE_UNIQUE(prefix, header_t, OPS) \
+  static inline int prefix##_unique(header_t *header) { \
+    return (OPS##_LOAD(&header->counts, memory_order_acquire) & ~__ARC_PREFIXED) == \
+      (__ARC_UNIT(__ARC_STRONG_SHIFT) | __ARC_UNIT(__ARC_WEAK_SHIFT)); \
+  }
+#else
+#define __ARC_STRONG(header) (&(header)->strong_count)
+#define __ARC_WEAK(header) (&(header)->weak_count)
+#define __ARC_STRONG_SHIFT 0
+#define __ARC_WEAK_SHIFT 1
+#define __ARC_INIT_COUNTS(OPS, header) \
+  (OPS##_STORE(&(header)->strong_count, __ARC_UNIT(__ARC_STRONG_SHIFT), memory_order_relaxed), \
+   OPS##_STORE(&(header)->weak_count, __ARC_UNIT(__ARC_WEAK_SHIFT), memory_order_relaxed))
+#define __ARC_LONE_WEAK(OPS, header, n) 0
+// the counts sit apart, so we lock the weak count (which only works while
+// the implicit weak is the only one) to stop a downgrade sneaking in between
+// our two loads, exactly like rust's is_unique... downgrade spins while it
+// sees the lock
+#define __ARC_DEFINE_UNIQUE(prefix, header_t, OPS) \
+  static inline int prefix##_unique(header_t *header) { \
+    __arc_word_t prefixed = OPS##_LOAD(&header->weak_count, memory_order_relaxed) & __ARC_PREFIXED; \
+    __arc_word_t one = prefixed | __ARC_UNIT(__ARC_WEAK_SHIFT); \
+    if (!OPS##_CAS( \
+      &header->weak_count, \
+      &one, prefixed | (__arc_word_t) __ARC_WEAK_LOCKED << __ARC_WEAK_SHIFT, \
+      memory_order_acquire, \
+      memory_order_relaxed) \
+    ) { \
+      return 0; \
+    } \
+    int unique = OPS##_LOAD(&header->strong_count, memory_order_acquire) == __ARC_UNIT(__ARC_STRONG_SHIFT); \
+    OPS##_STORE(&header->weak_count, prefixed | __ARC_UNIT(__ARC_WEAK_SHIFT), memory_order_release); \
+    return unique; \
+  }
+#endif // ARC_PACKED_COUNTS
+
+// a count out of its word, a word holding just one of it, and the bits of
+// the word that count owns
+#define __ARC_FIELD(word, shift) ((__arc_count_t)((word) >> (shift)))
+#define __ARC_UNIT(shift) ((__arc_word_t) 1 << (shift))
+#define __ARC_MASK(shift) ((__arc_word_t) __ARC_COUNT_MAX << (shift))
+
+// the bit just under the weak count, set once on creation for arcs with an
+// arc_meta_t in front of the header and never touched again... plain arcs
+// don't have one, and so pay nothing for flags and offset
+#define __ARC_PREFIXED __ARC_UNIT(__ARC_WEAK_SHIFT - 1)
+
+// this represents the header for a reference counted fat pointer (arc_header_t
+// itself is up in the public section, so it can be embedded intrusively)
 // - see http://www.schemamania.org/jkl/essays/fat-pointer.pdf or any rustlang
 //   discussions for what a fat pointer is...
-typedef struct arc_header {
-  atomic_size_t weak_count;
-  atomic_size_t strong_count;
-} arc_header_t;
+//
+// arcs and rcs share the exact same layout, the only difference being whether
+// the counts are atomic
+__ARC_DEFINE_HEADER(rc_header, __arc_word_t)
+
+_Static_assert(sizeof(arc_header_t) == sizeof(rc_header_t), "arc and rc headers must match");
+#if defined(ARC_COMPACT_COUNTS) || defined(ARC_PACKED_COUNTS)
+_Static_assert(sizeof(arc_header_t) == 8, "compact headers are the two 32 bit counts and nothing else");
+#endif // ARC_COMPACT_COUNTS || ARC_PACKED_COUNTS
+
+// what sits directly in front of the header of any arc that isn't plain
+// (see __ARC_PREFIXED)... set once on creation and never touched again, so
+// it can be read without any synchronisation -> flags describe what lives in
+// front of it, offset is how far the header sits from the start of its block
+typedef struct arc_meta {
+  uint32_t flags;
+  uint32_t offset;
+} arc_meta_t;
+
+// optional prefix sitting directly in front of the meta, only present when
+// the meta has __ARC_FLAG_EXT set...
+typedef struct arc_ext {
+  const arc_allocator_t *allocator;
+  // run when arc_free and friends get a NULL destructor
+  void(*destructor)(void *);
+  size_t nbytes;
+} arc_ext_t;
 
 // statics come first...
 
+static const uint32_t __ARC_FLAG_EXT = 1u << 0;
+static const uint32_t __ARC_FLAG_POOL = 1u << 1;
+static const uint32_t __ARC_FLAG_BIASED = 1u << 2;
+static const uint32_t __ARC_FLAG_OWNED = 1u << 3;
+// data has padding before it for an alignment past the block's own
+static const uint32_t __ARC_FLAG_ALIGNED = 1u << 4;
+static const uint32_t __ARC_FLAG_SHM = 1u << 5;
+// the block leads with a pointer to its slot in the sample ring
+static const uint32_t __ARC_FLAG_SAMPLED = 1u << 6;
+static const uint32_t __ARC_FLAG_SHARDED = 1u << 7;
+static const uint32_t __ARC_FLAG_ARRAY = 1u << 8;
+// data is mapped read-only, so nobody gets to write through arc_get_mut
+static const uint32_t __ARC_FLAG_READONLY = 1u << 9;
+// the arc lives in an intern table, which it leaves along with its last strong
+static const uint32_t __ARC_FLAG_INTERNED = 1u << 10;
+// counts live in the traced prefix, and the cycle collector may come calling
+static const uint32_t __ARC_FLAG_TRACED = 1u << 11;
+
+// what an arc without a meta reads as... under ARC_POOL that means pooled,
+// and it's the heap arcs that carry a meta to say otherwise
+#ifdef ARC_POOL
+static const uint32_t __ARC_FLAGS_PLAIN = __ARC_FLAG_POOL;
+#else
+static const uint32_t __ARC_FLAGS_PLAIN = 0;
+#endif // ARC_POOL
+
 static const size_t __ARC_ALIGN_BITS = sizeof(uintptr_t)-1;
 static const size_t __ARC_HEADER_SIZE_WITH_PAD = \
   (sizeof(arc_header_t)+__ARC_ALIGN_BITS) & ~__ARC_ALIGN_BITS;
 
-static const size_t __ARC_WEAK_MAX_REFS = SIZE_MAX>>1;
+// (the weak count gives up its low bit to __ARC_PREFIXED, leaving room for
+// the max, the sticky refs past it, and the lock past those)
+static const __arc_count_t __ARC_WEAK_MAX_REFS = __ARC_COUNT_MAX>>2;
+// what the weak count reads while someone checks for uniqueness
+static const __arc_count_t __ARC_WEAK_LOCKED = __ARC_COUNT_MAX>>1;
 
 static arc_header_t *__get_header(void *data) {
   // cant use void pointers with arithmetic, so we cast to a single byte type
@@ -90,175 +691,4286 @@ static arc_header_t *__get_header(void *data) {
   return (arc_header_t *)((uint8_t *) data - __ARC_HEADER_SIZE_WITH_PAD);
 }
 
-// then comes the public api...
+// what to do when a count is about to run past __ARC_WEAK_MAX_REFS...
+// - ARC_OVERFLOW_ERRNO (the default) fails the clone with ETOOMANYREFS, which
+//   means checking before every increment, so every increment is a CAS loop
+// - ARC_OVERFLOW_ABORT and ARC_OVERFLOW_SATURATE let clones get away with a
+//   single fetch_add, and either abort (like rust does) or let the count
+//   stick at __ARC_STICKY_REFS, leaking the arc rather than ever freeing it
+//   while someone still holds it
+// whichever it is, arc_make_immortal sticks counts on purpose, and once stuck
+// a count is left alone by everyone... they all check with a relaxed load
+// before their RMW, so an immortal arc's line never leaves the shared state
+#if defined(ARC_OVERFLOW_ABORT) && defined(ARC_OVERFLOW_SATURATE)
+#error "pick one of ARC_OVERFLOW_ABORT and ARC_OVERFLOW_SATURATE"
+#endif
 
-void *arc_new(size_t nbytes) {
-  if (nbytes == 0) {
-    return NULL;
+static const __arc_count_t __ARC_STICKY_REFS = __ARC_WEAK_MAX_REFS + (__ARC_WEAK_MAX_REFS>>1);
+
+// anything past the max is stuck, and drops leave it alone... since racing
+// increments can only ever push a handful past the max before one of them
+// sticks it, there is no way back down
+#define __ARC_STUCK(OPS, obj, shift) \
+  (__ARC_FIELD(OPS##_LOAD(obj, memory_order_relaxed), shift) > __ARC_WEAK_MAX_REFS)
+#define __ARC_STICK(word, shift) \
+  (((word) & ~__ARC_MASK(shift)) | (__arc_word_t) __ARC_STICKY_REFS << (shift))
+
+#if defined(ARC_OVERFLOW_SATURATE)
+#define __ARC_ON_OVERFLOW(snapshot, next, shift, data) \
+  if (__ARC_FIELD(snapshot, shift) > __ARC_WEAK_MAX_REFS) { \
+    return data; \
+  } \
+  next = __ARC_STICK(snapshot, shift);
+#define __ARC_ON_FETCH_OVERFLOW(OPS, obj, shift) { \
+    /* the other count may share the word, so only our bits get stuck */ \
+    __arc_word_t stuck = OPS##_LOAD(obj, memory_order_relaxed); \
+    while (!OPS##_CAS(obj, &stuck, __ARC_STICK(stuck, shift), memory_order_relaxed, memory_order_relaxed)); \
   }
-  void *data = malloc(__ARC_HEADER_SIZE_WITH_PAD + nbytes);
-  if (data == NULL) {
-    return NULL;
+#elif defined(ARC_OVERFLOW_ABORT)
+// only an immortal arc can be past the max already
+#define __ARC_ON_OVERFLOW(snapshot, next, shift, data) \
+  if (__ARC_FIELD(snapshot, shift) > __ARC_WEAK_MAX_REFS) { \
+    return data; \
+  } \
+  abort();
+#define __ARC_ON_FETCH_OVERFLOW(OPS, obj, shift) abort();
+#else
+#define __ARC_ON_OVERFLOW(snapshot, next, shift, data) \
+  if (__ARC_FIELD(snapshot, shift) > __ARC_WEAK_MAX_REFS) { \
+    return data; \
+  } \
+  errno = ETOOMANYREFS; \
+  return NULL;
+#endif
+
+// called with the name of the loop every time one of the CAS loops below has
+// to go round again, define it before including to count contention...
+#ifndef ARC_ON_RETRY
+#define ARC_ON_RETRY(site) ((void) 0)
+#endif // ARC_ON_RETRY
+
+// the user's hook, plus whatever the family counts (see ARC_STATS below)
+#define __ARC_RETRY(OPS, counter, site) (ARC_ON_RETRY(site), OPS##_STAT(counter, 1))
+
+// the counting protocol, written once against a set of operations OPS and
+// stamped out (inline, so a family is free to skip the bits it doesnt use)
+// for each family below... OPS##_LOAD and friends follow their
+// stdatomic namesakes (rcs just ignore the orderings). a few notes:
+//
+// - drop_strong could use acqrel, but only the last decrement needs acquire,
+//   and others only need release (thank you mara bos)... and as per C11 
+//   7.17.4:
+//   "An atomic operation A that is a release operation on an atomic 
+//   object M synchronizes with an acquire fence B if there exists some 
+//   atomic operation X on M such that X is sequenced before B and reads 
+//   the value written by A or a value written by any side effect in the 
+//   release sequence headed by A."
+//   - crucially, since fetch_sub performs a read, we can make use of an
+//     acquire fence!
+// - drop_weak is the same deal; the weak manages the allocation, so we need
+//   to see if there is a single weak survivor left (very likely the last
+//   arc_t), and establish a happens-before with every release decrement 
+//   before deallocating...
+// - clone needs to see if any decrements to 0 happened in between the load,
+//   beyond that we dont really care when it completes, just that it does...
+//   unless the overflow policy lets it fetch_add, in which case the strong
+//   we hold means it cant be 0 anyway
+// - downgrade must CAS, since weak_count could change to 0 after we take our 
+//   snapshot, so we cannot just use a fetch_add here, we could get a race
+//   when the last weak pointer is dropped...
+// - weak_clone only cares about overflow, weaks can do whatever they want lol
+// - upgrade must CAS in case strong_count changes, and acquires the memory 
+//   effects released by decrement... any thread that successfully upgrades
+//   a weak can 'see' all writes made prior to final drop of last strong
+#define __ARC_DEFINE_COUNTS(prefix, header_t, OPS) \
+  static inline void prefix##_init_counts(header_t *header) { \
+    __ARC_INIT_COUNTS(OPS, header); \
+  } \
+  \
+  static inline __arc_count_t prefix##_strong_count(header_t *header) { \
+    return __ARC_FIELD(OPS##_LOAD(__ARC_STRONG(header), memory_order_relaxed), __ARC_STRONG_SHIFT); \
+  } \
+  \
+  static inline __arc_count_t prefix##_weak_count(header_t *header) { \
+    return __ARC_FIELD(OPS##_LOAD(__ARC_WEAK(header), memory_order_relaxed), __ARC_WEAK_SHIFT); \
+  } \
+  \
+  static inline int prefix##_drop_strong_n(header_t *header, size_t n) { \
+    if (__ARC_STUCK(OPS, __ARC_STRONG(header), __ARC_STRONG_SHIFT)) { \
+      return 0; \
+    } \
+    __arc_word_t prev = OPS##_FETCH_SUB( \
+      __ARC_STRONG(header), (__arc_word_t) n << __ARC_STRONG_SHIFT, memory_order_release \
+    ); \
+    /* are we the last (strong) survivors? */ \
+    if (__ARC_FIELD(prev, __ARC_STRONG_SHIFT) != n) { \
+      return 0; \
+    } \
+    OPS##_FENCE(memory_order_acquire); \
+    return 1; \
+  } \
+  \
+  static inline int prefix##_drop_strong(header_t *header) { \
+    return prefix##_drop_strong_n(header, 1); \
+  } \
+  \
+  static inline int prefix##_drop_weak_n(header_t *header, size_t n) { \
+    if (__ARC_STUCK(OPS, __ARC_WEAK(header), __ARC_WEAK_SHIFT)) { \
+      return 0; \
+    } \
+    if (__ARC_LONE_WEAK(OPS, header, n)) { \
+      return 1; \
+    } \
+    __arc_word_t prev = OPS##_FETCH_SUB( \
+      __ARC_WEAK(header), (__arc_word_t) n << __ARC_WEAK_SHIFT, memory_order_release \
+    ); \
+    if (__ARC_FIELD(prev, __ARC_WEAK_SHIFT) != n) { \
+      return 0; \
+    } \
+    OPS##_FENCE(memory_order_acquire); \
+    return 1; \
+  } \
+  \
+  static inline int prefix##_drop_weak(header_t *header) { \
+    return prefix##_drop_weak_n(header, 1); \
+  } \
+  \
+  __ARC_DEFINE_INCREMENTS(prefix, header_t, OPS) \
+  __ARC_DEFINE_UNIQUE(prefix, header_t, OPS) \
+  \
+  static inline void *prefix##_downgrade(header_t *header, void *data) { \
+    __arc_word_t snapshot = OPS##_LOAD(__ARC_WEAK(header), memory_order_relaxed); \
+    for (;;) { \
+      __arc_word_t next = snapshot + __ARC_UNIT(__ARC_WEAK_SHIFT); \
+      /* someone is checking they're unique, which won't take long... */ \
+      if (__ARC_FIELD(snapshot, __ARC_WEAK_SHIFT) == __ARC_WEAK_LOCKED) { \
+        snapshot = OPS##_LOAD(__ARC_WEAK(header), memory_order_relaxed); \
+        continue; \
+      } \
+      /* we dont care about current snapshot, so long as we dont overflow... */ \
+      if (__ARC_FIELD(snapshot, __ARC_WEAK_SHIFT) > __ARC_WEAK_MAX_REFS-1) { \
+        __ARC_ON_OVERFLOW(snapshot, next, __ARC_WEAK_SHIFT, data) \
+      } \
+      if (OPS##_CAS( \
+        __ARC_WEAK(header), \
+        &snapshot, next, \
+        memory_order_relaxed, \
+        memory_order_relaxed) \
+      ) { \
+        /* yup, success, a new weak can access the memory now... */ \
+        return data; \
+      } \
+      /* we go again... */ \
+      __ARC_RETRY(OPS, __ARC_STAT_DOWNGRADE_RETRIES, #prefix "_downgrade"); \
+    } \
+  } \
+  \
+  static inline void *prefix##_upgrade(header_t *header, void *data) { \
+    __arc_word_t snapshot = OPS##_LOAD(__ARC_STRONG(header), memory_order_relaxed); \
+    for (;;) { \
+      __arc_word_t next = snapshot + __ARC_UNIT(__ARC_STRONG_SHIFT); \
+      /* this is strong count we're talkin about, we care when it hits 0... */ \
+      if (__ARC_FIELD(snapshot, __ARC_STRONG_SHIFT) == 0) { \
+        errno = ENOENT; \
+        return NULL; \
+      } \
+      if (__ARC_FIELD(snapshot, __ARC_STRONG_SHIFT) > __ARC_WEAK_MAX_REFS-1) { \
+        __ARC_ON_OVERFLOW(snapshot, next, __ARC_STRONG_SHIFT, data) \
+      } \
+      if (OPS##_CAS( \
+        __ARC_STRONG(header), \
+        &snapshot, next, \
+        memory_order_acquire, \
+        memory_order_relaxed) \
+      ) { \
+        /* yup, success, a new arc can access the memory now... */ \
+        return data; \
+      } \
+      /* once more round the sun... */ \
+      __ARC_RETRY(OPS, __ARC_STAT_UPGRADE_RETRIES, #prefix "_upgrade"); \
+    } \
+  }
+
+#if defined(ARC_OVERFLOW_ABORT) || defined(ARC_OVERFLOW_SATURATE)
+#define __ARC_BUMP(OPS, obj, shift, data, n) \
+  if (__ARC_STUCK(OPS, obj, shift)) { \
+    return data; \
+  } \
+  if (n > __ARC_WEAK_MAX_REFS || __ARC_FIELD( \
+    OPS##_FETCH_ADD(obj, (__arc_word_t) n << (shift), memory_order_relaxed), shift \
+  ) > __ARC_WEAK_MAX_REFS - n) { \
+    __ARC_ON_FETCH_OVERFLOW(OPS, obj, shift) \
+  } \
+  return data;
+#define __ARC_DEFINE_INCREMENTS(prefix, header_t, OPS) \
+  static inline void *prefix##_clone_n(header_t *header, void *data, size_t n) { \
+    __ARC_BUMP(OPS, __ARC_STRONG(header), __ARC_STRONG_SHIFT, data, n) \
+  } \
+  \
+  static inline void *prefix##_weak_clone_n(header_t *header, void *data, size_t n) { \
+    __ARC_BUMP(OPS, __ARC_WEAK(header), __ARC_WEAK_SHIFT, data, n) \
+  } \
+  __ARC_DEFINE_SINGLE_INCREMENTS(prefix, header_t)
+#else
+#define __ARC_DEFINE_INCREMENTS(prefix, header_t, OPS) \
+  static inline void *prefix##_clone_n(header_t *header, void *data, size_t n) { \
+    __arc_word_t snapshot = OPS##_LOAD(__ARC_STRONG(header), memory_order_relaxed); \
+    for (;;) { \
+      __arc_count_t count = __ARC_FIELD(snapshot, __ARC_STRONG_SHIFT); \
+      if (count == 0) { \
+        /* we have nothing to upgrade into... */ \
+        errno = ENOENT; \
+        return NULL; \
+      } \
+      if (count > __ARC_WEAK_MAX_REFS) { \
+        /* immortal, nothing to count */ \
+        return data; \
+      } \
+      if (n > __ARC_WEAK_MAX_REFS || count > __ARC_WEAK_MAX_REFS - n) { \
+        errno = ETOOMANYREFS; \
+        return NULL; \
+      } \
+      if (OPS##_CAS( \
+        __ARC_STRONG(header), \
+        &snapshot, snapshot + ((__arc_word_t) n << __ARC_STRONG_SHIFT), \
+        memory_order_acquire, \
+        memory_order_relaxed) \
+      ) { \
+        return data; \
+      } \
+      /* go again... */ \
+      __ARC_RETRY(OPS, __ARC_STAT_CLONE_RETRIES, #prefix "_clone"); \
+    } \
+  } \
+  \
+  static inline void *prefix##_weak_clone_n(header_t *header, void *data, size_t n) { \
+    __arc_word_t snapshot = OPS##_LOAD(__ARC_WEAK(header), memory_order_relaxed); \
+    for (;;) { \
+      __arc_count_t count = __ARC_FIELD(snapshot, __ARC_WEAK_SHIFT); \
+      if (count > __ARC_WEAK_MAX_REFS) { \
+        return data; \
+      } \
+      if (n > __ARC_WEAK_MAX_REFS || count > __ARC_WEAK_MAX_REFS - n) { \
+        errno = ETOOMANYREFS; \
+        return NULL; \
+      } \
+      if (OPS##_CAS( \
+        __ARC_WEAK(header), \
+        &snapshot, snapshot + ((__arc_word_t) n << __ARC_WEAK_SHIFT), \
+        memory_order_relaxed, \
+        memory_order_relaxed) \
+      ) { \
+        return data; \
+      } \
+      /* AGAIN! */ \
+      __ARC_RETRY(OPS, __ARC_STAT_WEAK_CLONE_RETRIES, #prefix "_weak_clone"); \
+    } \
+  } \
+  __ARC_DEFINE_SINGLE_INCREMENTS(prefix, header_t)
+#endif
+
+// n refs in one rmw is the same as one ref in one rmw, so the single
+// versions just forward (and the constant folds right back out)
+#define __ARC_DEFINE_SINGLE_INCREMENTS(prefix, header_t) \
+  \
+  static inline void *prefix##_clone(header_t *header, void *data) { \
+    return prefix##_clone_n(header, data, 1); \
+  } \
+  \
+  static inline void *prefix##_weak_clone(header_t *header, void *data) { \
+    return prefix##_weak_clone_n(header, data, 1); \
+  }
+
+// ARC_STATS keeps a slot of counters per thread, each on its own cache
+// line... a thread only ever writes its own slot, so bumping a counter is a
+// relaxed load and store rather than an rmw, and the atomics are only there
+// so arc_stats_snapshot can read them untorn from elsewhere. slots live on a
+// list (behind a mutex, only touched when a thread comes, goes or someone
+// snapshots), and a dying thread folds its counts into the spill slot, which
+// also catches anyone who couldn't get a slot of their own
+#ifdef ARC_STATS
+enum {
+  __ARC_STAT_ALLOCATIONS,
+  __ARC_STAT_FREES,
+  __ARC_STAT_BYTES_IN,
+  __ARC_STAT_BYTES_OUT,
+  __ARC_STAT_RC_ALLOCATIONS,
+  __ARC_STAT_RC_FREES,
+  __ARC_STAT_RC_BYTES_IN,
+  __ARC_STAT_RC_BYTES_OUT,
+  __ARC_STAT_CLONES,
+  __ARC_STAT_DOWNGRADES,
+  __ARC_STAT_UPGRADES,
+  __ARC_STAT_UPGRADE_FAILURES,
+  __ARC_STAT_CLONE_RETRIES,
+  __ARC_STAT_WEAK_CLONE_RETRIES,
+  __ARC_STAT_DOWNGRADE_RETRIES,
+  __ARC_STAT_UPGRADE_RETRIES,
+  __ARC_STAT_COUNTERS,
+};
+
+typedef struct arc_stats_slot {
+  _Alignas(ARC_CACHE_LINE_SIZE) _Atomic uint64_t counts[__ARC_STAT_COUNTERS];
+  struct arc_stats_slot *next;
+} arc_stats_slot_t;
+
+static arc_stats_slot_t __arc_stats_spill;
+static arc_stats_slot_t *__arc_stats_slots;
+static pthread_mutex_t __arc_stats_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t __arc_stats_once = PTHREAD_ONCE_INIT;
+static pthread_key_t __arc_stats_key;
+static _Thread_local arc_stats_slot_t *__arc_stats_slot;
+
+static void __arc_stats_retire(void *arg) {
+  arc_stats_slot_t *slot = arg;
+  pthread_mutex_lock(&__arc_stats_lock);
+  for (size_t i = 0; i < __ARC_STAT_COUNTERS; ++i) {
+    uint64_t count = atomic_load_explicit(&slot->counts[i], memory_order_relaxed);
+    atomic_fetch_add_explicit(&__arc_stats_spill.counts[i], count, memory_order_relaxed);
   }
-  arc_header_t *header = data;
-  atomic_init(&header->strong_count, 1);
-  atomic_init(&header->weak_count, 1);
-  return (uint8_t *) data + __ARC_HEADER_SIZE_WITH_PAD;
+  arc_stats_slot_t **link = &__arc_stats_slots;
+  while (*link != slot) {
+    link = &(*link)->next;
+  }
+  *link = slot->next;
+  pthread_mutex_unlock(&__arc_stats_lock);
+  free(slot);
+  // anything this thread still does on the way out goes straight to spill
+  __arc_stats_slot = &__arc_stats_spill;
 }
 
-void arc_free(void *arc_data, void(*destructor)(void *)) {
-  arc_header_t *header = __get_header(arc_data);
-  // could use acqrel, but only the last decrement needs acquire, and others 
-  // only need release (thank you mara bos)
-  size_t prev = atomic_fetch_sub_explicit(&header->strong_count, 1, memory_order_release);
-  // are we the last (strong) survivor?
-  if (prev == 1) {
-    // but first, as per C11 7.17.4:
-    // "An atomic operation A that is a release operation on an atomic 
-    // object M synchronizes with an acquire fence B if there exists some 
-    // atomic operation X on M such that X is sequenced before B and reads 
-    // the value written by A or a value written by any side effect in the 
-    // release sequence headed by A."
-    // - crucially, since fetch_sub performs a read, we can make use of an
-    //   acquire fence!
-    atomic_thread_fence(memory_order_acquire);
-    // we have observed that we are the final surviving arc -> since we own
-    // the data, we must now destroy it. delegate responsibility of freeing
-    // the allocation to the weak pointer we implicitly own below...
-    if (destructor != NULL) {
-      destructor(arc_data);
-    }
-    // as noted, we now just free the symbolic weak we still hold
-    void *weak_data = arc_data;
-    weak_free(weak_data);
+static void __arc_stats_init(void) {
+  pthread_key_create(&__arc_stats_key, __arc_stats_retire);
+}
+
+static arc_stats_slot_t *__arc_stats_register(void) {
+  pthread_once(&__arc_stats_once, __arc_stats_init);
+  arc_stats_slot_t *slot = aligned_alloc(ARC_CACHE_LINE_SIZE, sizeof(arc_stats_slot_t));
+  if (slot == NULL || pthread_setspecific(__arc_stats_key, slot) != 0) {
+    free(slot);
+    return __arc_stats_slot = &__arc_stats_spill;
+  }
+  for (size_t i = 0; i < __ARC_STAT_COUNTERS; ++i) {
+    atomic_init(&slot->counts[i], 0);
   }
+  pthread_mutex_lock(&__arc_stats_lock);
+  slot->next = __arc_stats_slots;
+  __arc_stats_slots = slot;
+  pthread_mutex_unlock(&__arc_stats_lock);
+  return __arc_stats_slot = slot;
 }
 
-void *arc_clone(void *arc_data) {
-  arc_header_t *header = __get_header(arc_data);
-  size_t snapshot = atomic_load_explicit(&header->strong_count, memory_order_relaxed);
-  for (;;) {
-    if (snapshot == 0) {
-      // we have nothing to upgrade into...
-      errno = ENOENT;
-      return NULL;
-    }
-    if (snapshot >= __ARC_WEAK_MAX_REFS) {
-      errno = ETOOMANYREFS;
+static void __arc_stats_add(size_t counter, uint64_t n) {
+  arc_stats_slot_t *slot = __arc_stats_slot;
+  if (slot == NULL) {
+    slot = __arc_stats_register();
+  }
+  if (slot == &__arc_stats_spill) {
+    // shared with whoever else ended up here, so this one has to be an rmw
+    atomic_fetch_add_explicit(&slot->counts[counter], n, memory_order_relaxed);
+    return;
+  }
+  uint64_t count = atomic_load_explicit(&slot->counts[counter], memory_order_relaxed);
+  atomic_store_explicit(&slot->counts[counter], count + n, memory_order_relaxed);
+}
+
+// every block (bar shm ones, which other processes free) starts with the
+// size its data was asked for, so a free knows how many bytes went with it
+static const size_t __ARC_STATS_LEAD = sizeof(size_t);
+
+#define __ARC_STAT(counter, n) __arc_stats_add((counter), (uint64_t)(n))
+#else
+static const size_t __ARC_STATS_LEAD = 0;
+
+#define __ARC_STAT(counter, n) ((void) 0)
+#endif // ARC_STATS
+
+#define __ARC_OPS_LOAD atomic_load_explicit
+#define __ARC_OPS_STORE atomic_store_explicit
+#define __ARC_OPS_CAS atomic_compare_exchange_weak_explicit
+#define __ARC_OPS_FETCH_ADD atomic_fetch_add_explicit
+#define __ARC_OPS_FETCH_SUB atomic_fetch_sub_explicit
+#define __ARC_OPS_FENCE atomic_thread_fence
+#define __ARC_OPS_STAT __ARC_STAT
+
+// rcs never leave their thread, so plain loads and stores will do...
+#define __RC_OPS_LOAD(obj, order) (*(obj))
+#define __RC_OPS_STORE(obj, value, order) (*(obj) = (value))
+#define __RC_OPS_CAS(obj, expected, desired, success, failure) \
+  (*(obj) == *(expected) ? (*(obj) = (desired), 1) : (*(expected) = *(obj), 0))
+#define __RC_OPS_FETCH_ADD(obj, n, order) ((*(obj) += (n)) - (n))
+#define __RC_OPS_FETCH_SUB(obj, n, order) ((*(obj) -= (n)) + (n))
+#define __RC_OPS_FENCE(order) ((void) 0)
+#define __RC_OPS_STAT(counter, n) ((void) 0)
+
+__ARC_DEFINE_COUNTS(__arc, arc_header_t, __ARC_OPS)
+__ARC_DEFINE_COUNTS(__rc, rc_header_t, __RC_OPS)
+
+static int __arc_prefixed(arc_header_t *header) {
+  return (atomic_load_explicit(__ARC_WEAK(header), memory_order_relaxed) & __ARC_PREFIXED) != 0;
+}
+
+static arc_meta_t *__get_meta(arc_header_t *header) {
+  return (arc_meta_t *) header - 1;
+}
+
+static uint32_t __arc_flags(arc_header_t *header) {
+  return __arc_prefixed(header) ? __get_meta(header)->flags : __ARC_FLAGS_PLAIN;
+}
+
+// plain arcs only ever have the stats lead in front of them
+static size_t __arc_offset(arc_header_t *header) {
+  return __arc_prefixed(header) ? __get_meta(header)->offset : __ARC_STATS_LEAD;
+}
+
+// before anyone else can see the header, so the bit goes in with a plain rmw
+static void __arc_init_meta(arc_header_t *header, uint32_t flags, size_t offset) {
+  __arc_word_t weak = atomic_load_explicit(__ARC_WEAK(header), memory_order_relaxed);
+  atomic_store_explicit(__ARC_WEAK(header), weak | __ARC_PREFIXED, memory_order_relaxed);
+  __get_meta(header)->flags = flags;
+  __get_meta(header)->offset = (uint32_t) offset;
+}
+
+// biased, sharded and traced arcs keep their strongs somewhere other than
+// strong_count, and whichever of those arc_data is comes back... plain arcs
+// (the common case by far) can't be any of them, so one test of the bit
+// sees them through without ever touching the meta
+static const uint32_t __ARC_FLAGS_COUNTED = __ARC_FLAG_BIASED | __ARC_FLAG_SHARDED | __ARC_FLAG_TRACED;
+
+static uint32_t __arc_counted(arc_header_t *header) {
+  if (__builtin_expect(!__arc_prefixed(header), 1)) {
+    return 0;
+  }
+  return __get_meta(header)->flags & __ARC_FLAGS_COUNTED;
+}
+
+static arc_ext_t *__get_ext(arc_header_t *header) {
+  return (arc_ext_t *) __get_meta(header) - 1;
+}
+
+// and back again, from a prefix sitting directly in front of the ext
+static arc_header_t *__get_prefixed_header(void *prefix_end) {
+  return (arc_header_t *)((arc_meta_t *)((arc_ext_t *) prefix_end + 1) + 1);
+}
+
+static void __arc_ext_init(arc_header_t *header, const arc_allocator_t *allocator, size_t nbytes, void(*destructor)(void *)) {
+  arc_ext_t *ext = __get_ext(header);
+  ext->allocator = allocator;
+  ext->destructor = destructor;
+  ext->nbytes = nbytes;
+}
+
+// array arcs carry the shape of their data in front of their ext...
+//   [arc_array_t][arc_ext_t][arc_header_t][data]
+// and the ext's destructor walks the elements when there's one to run
+typedef struct arc_array {
+  size_t count;
+  size_t elem_size;
+  void(*elem_destructor)(void *);
+} arc_array_t;
+
+static arc_array_t *__get_array(arc_header_t *header) {
+  return (arc_array_t *) __get_ext(header) - 1;
+}
+
+static void __arc_array_destroy(void *arc_data) {
+  arc_array_t *array = __get_array(__get_header(arc_data));
+  for (size_t i = 0; i < array->count; ++i) {
+    array->elem_destructor((uint8_t *) arc_data + i * array->elem_size);
+  }
+}
+
+// every thread draws a number the first time it asks who it is... never 0
+// and never handed out twice, unlike a thread local's address, which the
+// next thread to come along is free to land on
+static atomic_size_t __arc_thread_ids;
+static _Thread_local size_t __arc_thread_id;
+
+static size_t __arc_self(void) {
+  if (__arc_thread_id == 0) {
+    // all we need is for no two threads to draw the same one, so relaxed
+    __arc_thread_id = atomic_fetch_add_explicit(&__arc_thread_ids, 1, memory_order_relaxed) + 1;
+  }
+  return __arc_thread_id;
+}
+
+static void *__arc_libc_alloc(void *ctx, size_t nbytes) {
+  (void) ctx;
+  return malloc(nbytes);
+}
+
+static void __arc_libc_free(void *ctx, void *ptr) {
+  (void) ctx;
+  free(ptr);
+}
+
+static void *__arc_libc_realloc(void *ctx, void *ptr, size_t nbytes) {
+  (void) ctx;
+  return realloc(ptr, nbytes);
+}
+
+static const arc_allocator_t __ARC_LIBC_ALLOCATOR = {
+  __arc_libc_alloc, __arc_libc_free, NULL, __arc_libc_realloc
+};
+
+// mapped arcs come from an allocator of their own, one for each combination
+// of arc_map_flags_t (which it finds through ctx)... every mapping starts
+// with its own length, since munmap needs it and free doesn't get told
+#ifndef ARC_MAP_THRESHOLD
+#define ARC_MAP_THRESHOLD ((size_t) 64 << 20)
+#endif // ARC_MAP_THRESHOLD
+
+#ifndef ARC_HUGE_PAGE_SIZE
+#define ARC_HUGE_PAGE_SIZE ((size_t) 2 << 20)
+#endif // ARC_HUGE_PAGE_SIZE
+
+// keeps the block behind it as aligned as malloc's would be
+static const size_t __ARC_MAP_LEAD = 16;
+
+static const unsigned __ARC_MAP_MODES[] = {0, 1, 2, 3, 4, 5, 6, 7};
+
+static size_t __arc_page_size(void) {
+  return (size_t) sysconf(_SC_PAGESIZE);
+}
+
+static uint8_t *__arc_map(size_t length, int flags) {
+  void *base = mmap(NULL, length, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | flags, -1, 0);
+  return base != MAP_FAILED ? base : NULL;
+}
+
+static void *__arc_map_alloc(void *ctx, size_t nbytes) {
+  unsigned mode = *(const unsigned *) ctx;
+  if (nbytes > SIZE_MAX - __ARC_MAP_LEAD - ARC_HUGE_PAGE_SIZE) {
+    return NULL;
+  }
+  int populate = 0;
+#ifdef MAP_POPULATE
+  populate = (mode & ARC_MAP_POPULATE) ? MAP_POPULATE : 0;
+#endif // MAP_POPULATE
+  uint8_t *base = NULL;
+  size_t length = 0;
+#ifdef MAP_HUGETLB
+  if (mode & ARC_MAP_HUGETLB) {
+    length = (nbytes + __ARC_MAP_LEAD + ARC_HUGE_PAGE_SIZE - 1) & ~(ARC_HUGE_PAGE_SIZE - 1);
+    base = __arc_map(length, MAP_HUGETLB | populate);
+  }
+#endif // MAP_HUGETLB
+  if (base == NULL) {
+    size_t page = __arc_page_size();
+    length = (nbytes + __ARC_MAP_LEAD + page - 1) & ~(page - 1);
+    base = __arc_map(length, populate);
+    if (base == NULL) {
       return NULL;
     }
-    // we dont really care when this operation completes, just that it does...
-    if (atomic_compare_exchange_weak_explicit(
-      &header->strong_count, 
-      &snapshot, snapshot + 1,
-      // we need to see if any decrements to 0 happened in between the load...
-      memory_order_acquire, 
-      memory_order_relaxed)
-    ) {
-      return arc_data;
+#ifdef MADV_HUGEPAGE
+    // only ever a hint, so whether it took doesn't matter
+    if (mode & (ARC_MAP_THP | ARC_MAP_HUGETLB)) {
+      madvise(base, length, MADV_HUGEPAGE);
     }
-    // go again...
+#endif // MADV_HUGEPAGE
   }
+  *(size_t *) base = length;
+  return base + __ARC_MAP_LEAD;
 }
 
-void *arc_downgrade(void *arc_data) {
-  arc_header_t *header = __get_header(arc_data);
-  // must CAS this, since weak_count could change to 0 after we take our 
-  // snapshot, so we cannot just use a fetch_add here, we could get a race
-  // when the last weak pointer is dropped...
-  size_t snapshot = atomic_load_explicit(&header->weak_count, memory_order_relaxed);
-  for (;;) {
-    // we dont care about current snapshot, so long as we dont overflow...
-    if (snapshot > __ARC_WEAK_MAX_REFS-1) {
-      // catch overflow, same as clone...
-      errno = ETOOMANYREFS;
-      return NULL;
+static void __arc_map_free(void *ctx, void *ptr) {
+  (void) ctx;
+  uint8_t *base = (uint8_t *) ptr - __ARC_MAP_LEAD;
+  munmap(base, *(size_t *) base);
+}
+
+#define __ARC_MAP_ALLOCATOR(mode) \
+  {__arc_map_alloc, __arc_map_free, (void *) &__ARC_MAP_MODES[mode], NULL}
+
+static const arc_allocator_t __ARC_MAP_ALLOCATORS[] = {
+  __ARC_MAP_ALLOCATOR(0), __ARC_MAP_ALLOCATOR(1), __ARC_MAP_ALLOCATOR(2), __ARC_MAP_ALLOCATOR(3),
+  __ARC_MAP_ALLOCATOR(4), __ARC_MAP_ALLOCATOR(5), __ARC_MAP_ALLOCATOR(6), __ARC_MAP_ALLOCATOR(7),
+};
+
+// numa placement goes straight to the syscalls rather than pulling in
+// libnuma... a node allocator keeps a free list per power of two size class
+// for each node, carving fresh blocks off slabs that were mapped and bound
+// (preferred, so a full node still hands out memory) to the node once, and
+// slabs stay with their class for good. blocks too big for any class get a
+// mapping of their own, bound the same way, which moves the one page the
+// length prefix has already touched. the lead word of a block says which it
+// is -> a mapping's length (whole pages, so the low bit is clear) or its
+// class with the low bit set. nodes are just the ctx, filled in once on
+// first use
+#ifndef ARC_MAX_NODES
+#define ARC_MAX_NODES 64
+#endif // ARC_MAX_NODES
+
+#ifndef ARC_NODE_SLAB_SIZE
+#define ARC_NODE_SLAB_SIZE ((size_t) 1 << 20)
+#endif // ARC_NODE_SLAB_SIZE
+
+// classes go 64 bytes, 128, ... up to 64KB (lead included)
+#define __ARC_NODE_CLASSES 11
+#define __ARC_NODE_MIN_BLOCK ((size_t) 64)
+#define __ARC_NODE_MAX_BLOCK (__ARC_NODE_MIN_BLOCK << (__ARC_NODE_CLASSES - 1))
+
+_Static_assert(ARC_NODE_SLAB_SIZE >= 4 * __ARC_NODE_MAX_BLOCK, "ARC_NODE_SLAB_SIZE has to fit a few of the biggest blocks");
+
+typedef struct arc_node_class {
+  pthread_mutex_t lock;
+  // blocks handed back, linked through the second word of their lead
+  uint8_t *free;
+  // what's left of the slab we're carving
+  uint8_t *next;
+  uint8_t *end;
+  size_t size;
+  // -1 for memory that isn't bound anywhere
+  int node;
+} arc_node_class_t;
+
+static const int __ARC_MPOL_PREFERRED = 1;
+static const unsigned __ARC_MPOL_MF_MOVE = 1u << 1;
+static const int __ARC_MPOL_F_NODE = 1 << 0;
+static const int __ARC_MPOL_F_ADDR = 1 << 1;
+
+#define __ARC_NODE_MASK_WORDS ((ARC_MAX_NODES + 8 * sizeof(unsigned long) - 1) / (8 * sizeof(unsigned long)))
+
+// slot 0 is ARC_NODE_LOCAL, the rest go in node order
+static int __arc_nodes[ARC_MAX_NODES + 1];
+static arc_allocator_t __arc_node_allocators[ARC_MAX_NODES + 1];
+// one row of classes per node, and a last one for memory bound nowhere
+static arc_node_class_t __arc_node_classes[ARC_MAX_NODES + 1][__ARC_NODE_CLASSES];
+static pthread_once_t __arc_nodes_once = PTHREAD_ONCE_INIT;
+
+// placement is only ever a preference, so whether the bind took (the node
+// might not even be there) doesn't change what we hand back
+static void __arc_node_bind(uint8_t *base, size_t length, int node) {
+#ifdef SYS_mbind
+  unsigned long mask[__ARC_NODE_MASK_WORDS] = {0};
+  mask[(size_t) node / (8 * sizeof(unsigned long))] |= 1ul << ((size_t) node % (8 * sizeof(unsigned long)));
+  // the kernel counts one bit fewer than it's told, as libnuma knows well
+  (void) syscall(SYS_mbind, base, length, __ARC_MPOL_PREFERRED, mask, (unsigned long) ARC_MAX_NODES + 1, __ARC_MPOL_MF_MOVE);
+#else
+  (void) base;
+  (void) length;
+  (void) node;
+#endif // SYS_mbind
+}
+
+static void *__arc_node_slab_alloc(arc_node_class_t *size_class) {
+  pthread_mutex_lock(&size_class->lock);
+  uint8_t *base = size_class->free;
+  if (base != NULL) {
+    size_class->free = ((uint8_t **) base)[1];
+  } else {
+    if (size_class->next == size_class->end) {
+      uint8_t *slab = __arc_map(ARC_NODE_SLAB_SIZE, 0);
+      if (slab == NULL) {
+        pthread_mutex_unlock(&size_class->lock);
+        return NULL;
+      }
+      if (size_class->node >= 0) {
+        __arc_node_bind(slab, ARC_NODE_SLAB_SIZE, size_class->node);
+      }
+      size_class->next = slab;
+      size_class->end = slab + ARC_NODE_SLAB_SIZE;
     }
-    // are we able to increment by 1?
-    if (atomic_compare_exchange_weak_explicit(
-      &header->weak_count,
-      &snapshot, snapshot + 1,
-      memory_order_relaxed,
-      memory_order_relaxed)
-    ) {
-      // yup, success, a new weak can access the memory now...
-      void *weak_data = arc_data;
-      return weak_data;
+    base = size_class->next;
+    size_class->next += size_class->size;
+    *(uintptr_t *) base = (uintptr_t) size_class | 1;
+  }
+  pthread_mutex_unlock(&size_class->lock);
+  return base + __ARC_MAP_LEAD;
+}
+
+static void *__arc_node_alloc(void *ctx, size_t nbytes) {
+  int node = *(const int *) ctx;
+  if (node == ARC_NODE_LOCAL) {
+    node = arc_current_node();
+  }
+  if (node < 0 || node >= ARC_MAX_NODES) {
+    node = -1;
+  }
+  if (nbytes <= __ARC_NODE_MAX_BLOCK - __ARC_MAP_LEAD) {
+    size_t i = 0;
+    while ((__ARC_NODE_MIN_BLOCK << i) - __ARC_MAP_LEAD < nbytes) {
+      ++i;
     }
-    // we go again...
+    return __arc_node_slab_alloc(&__arc_node_classes[node >= 0 ? node : ARC_MAX_NODES][i]);
+  }
+  uint8_t *block = __arc_map_alloc((void *) &__ARC_MAP_MODES[0], nbytes);
+  if (block != NULL && node >= 0) {
+    uint8_t *base = block - __ARC_MAP_LEAD;
+    __arc_node_bind(base, *(size_t *) base, node);
   }
+  return block;
 }
 
-void weak_free(void *weak_data) {
-  arc_header_t *header = __get_header(weak_data);
-  // this part is cool; the weak manages the allocation, so we need to see
-  // if there is a single weak survivor left (very likely the last arc_t)...
-  // we mark this operation as visible on other threads through release...
-  size_t prev = atomic_fetch_sub_explicit(&header->weak_count, 1, memory_order_release);
-  // are we the last survivor?
-  if (prev == 1) {
-    // ok, lets deallocate...
-    // again we establish a happens-before with the above release decrement 
-    // for all modifications made ...
-    atomic_thread_fence(memory_order_acquire);
-    // we have exclusive access to the previously shared data, so we can 
-    // free its allocation...
-    free(header);
+static void __arc_node_free(void *ctx, void *ptr) {
+  uint8_t *base = (uint8_t *) ptr - __ARC_MAP_LEAD;
+  uintptr_t lead = *(uintptr_t *) base;
+  if (!(lead & 1)) {
+    __arc_map_free(ctx, ptr);
+    return;
   }
+  arc_node_class_t *size_class = (arc_node_class_t *)(lead & ~(uintptr_t) 1);
+  pthread_mutex_lock(&size_class->lock);
+  ((uint8_t **) base)[1] = size_class->free;
+  size_class->free = base;
+  pthread_mutex_unlock(&size_class->lock);
 }
 
-void *weak_clone(void *weak_data) {
-  arc_header_t *header = __get_header(weak_data);
-  size_t snapshot = atomic_load_explicit(&header->weak_count, memory_order_relaxed);
-  for (;;) {
-    // we only care about overflow, weaks can do whatever they want lol
-    if (snapshot > __ARC_WEAK_MAX_REFS-1) {
-      errno = ETOOMANYREFS;
-      return NULL;
+static void __arc_nodes_init(void) {
+  for (int i = 0; i <= ARC_MAX_NODES; ++i) {
+    __arc_nodes[i] = i - 1;
+    arc_allocator_t allocator = {__arc_node_alloc, __arc_node_free, &__arc_nodes[i], NULL};
+    __arc_node_allocators[i] = allocator;
+    for (size_t j = 0; j < __ARC_NODE_CLASSES; ++j) {
+      arc_node_class_t *size_class = &__arc_node_classes[i][j];
+      pthread_mutex_init(&size_class->lock, NULL);
+      size_class->free = size_class->next = size_class->end = NULL;
+      size_class->size = __ARC_NODE_MIN_BLOCK << j;
+      size_class->node = i < ARC_MAX_NODES ? i : -1;
     }
-    if (atomic_compare_exchange_weak_explicit(
-      &header->weak_count, 
-      &snapshot, snapshot + 1,
-      memory_order_relaxed,
-      memory_order_relaxed)
-    ) {
-      return weak_data;
+  }
+}
+
+// only written at startup, so a plain pointer does the job... arcs without an
+// ext prefix always go back to whatever lives here
+static const arc_allocator_t *__arc_allocator = &__ARC_LIBC_ALLOCATOR;
+
+#ifdef ARC_POOL
+
+// with ARC_POOL defined, small arcs made through the libc allocator skip
+// malloc entirely and come out of per-thread slabs instead... each slab is
+// carved into blocks of one size class, and since slabs are aligned to their
+// own size we can find the slab of any block by masking its address
+#ifndef ARC_POOL_SLAB_SIZE
+#define ARC_POOL_SLAB_SIZE ((size_t) 64 * 1024)
+#endif // ARC_POOL_SLAB_SIZE
+
+// largest block (prefix + header + data) served from the pool
+#ifndef ARC_POOL_MAX_BLOCK
+#define ARC_POOL_MAX_BLOCK ((size_t) 128)
+#endif // ARC_POOL_MAX_BLOCK
+
+#define __ARC_POOL_GRAIN ((size_t) 16)
+#define __ARC_POOL_CLASSES (ARC_POOL_MAX_BLOCK / __ARC_POOL_GRAIN)
+
+typedef struct arc_pool_slab {
+  // the thread that carved this slab, never changes
+  size_t owner;
+  // next slab of the same class owned by the same thread
+  struct arc_pool_slab *next;
+  // blocks freed by threads other than the owner, a treiber stack that only
+  // the owner ever empties (and it empties all of it at once, so no ABA)
+  _Atomic(void *) remote;
+  size_t block_size;
+  // blocks handed out and not yet back on the owner's free list, only the
+  // owner touches it
+  size_t used;
+  // once the owner has exited, blocks still out there less the ones that
+  // came back since... whoever takes it to zero frees the slab
+  atomic_intptr_t orphaned;
+} arc_pool_slab_t;
+
+typedef struct arc_pool_class {
+  // blocks freed by the owning thread, no atomics needed...
+  void *free;
+  // every slab this thread has carved for the class
+  arc_pool_slab_t *slabs;
+  // untouched tail of the newest slab
+  uint8_t *bump;
+  uint8_t *end;
+} arc_pool_class_t;
+
+static _Thread_local arc_pool_class_t __arc_pool_heap[__ARC_POOL_CLASSES];
+static _Thread_local int __arc_pool_registered;
+static pthread_key_t __arc_pool_key;
+static pthread_once_t __arc_pool_once = PTHREAD_ONCE_INIT;
+
+// what an exiting owner leaves on the remote stack of slabs it couldn't
+// free yet, telling remote frees to count down orphaned instead
+static char __arc_pool_orphan;
+
+static const size_t __ARC_POOL_SLAB_HEADER_SIZE = \
+  (sizeof(arc_pool_slab_t)+__ARC_POOL_GRAIN-1) & ~(__ARC_POOL_GRAIN-1);
+
+static arc_pool_slab_t *__arc_pool_slab_of(void *block) {
+  return (arc_pool_slab_t *)((uintptr_t) block & ~(uintptr_t)(ARC_POOL_SLAB_SIZE-1));
+}
+
+// a thread on its way out frees every slab that has nothing left out there,
+// and leaves the rest to be freed by whoever hands back their last block...
+static void __arc_pool_retire(void *arg) {
+  (void) arg;
+  // draw a fresh identity, anything we free from here on (later thread exit
+  // destructors included) takes the remote path
+  __arc_thread_id = 0;
+  for (size_t i = 0; i < __ARC_POOL_CLASSES; ++i) {
+    arc_pool_slab_t *slab = __arc_pool_heap[i].slabs;
+    while (slab != NULL) {
+      arc_pool_slab_t *next = slab->next;
+      // acquire the links of the blocks on the stack, same as a collect
+      void *head = atomic_exchange_explicit(&slab->remote, &__arc_pool_orphan, memory_order_acquire);
+      intptr_t outstanding = (intptr_t) slab->used;
+      for (; head != NULL; head = *(void **) head) {
+        --outstanding;
+      }
+      // remote frees that saw the orphan mark may have counted down already
+      if (outstanding == 0 || atomic_fetch_add_explicit(
+        &slab->orphaned, outstanding, memory_order_acq_rel) + outstanding == 0
+      ) {
+        free(slab);
+      }
+      slab = next;
     }
-    // AGAIN!
+    memset(&__arc_pool_heap[i], 0, sizeof(arc_pool_class_t));
   }
+  __arc_pool_registered = 0;
 }
 
-void *weak_upgrade(void *weak_data) {
-  arc_header_t *header = __get_header(weak_data);
-  // we must CAS in case strong_count changes... 
-  size_t snapshot = atomic_load_explicit(&header->strong_count, memory_order_relaxed);
+static void __arc_pool_init(void) {
+  pthread_key_create(&__arc_pool_key, __arc_pool_retire);
+}
+
+static void *__arc_pool_alloc(size_t nbytes) {
+  size_t index = (nbytes+__ARC_POOL_GRAIN-1) / __ARC_POOL_GRAIN - 1;
+  arc_pool_class_t *bucket = &__arc_pool_heap[index];
   for (;;) {
-    // this is strong count we're talkin about, we care when it hits 0...
-    if (snapshot == 0) {
-      errno = ENOENT;
-      return NULL;
+    // cheapest first, something we freed ourselves...
+    if (bucket->free != NULL) {
+      void *block = bucket->free;
+      bucket->free = *(void **) block;
+      ++__arc_pool_slab_of(block)->used;
+      return block;
     }
-    if (snapshot > __ARC_WEAK_MAX_REFS-1) {
-      // catch overflow, same as clone...
-      errno = ETOOMANYREFS;
+    // then whatever is left of the newest slab...
+    if (bucket->bump != bucket->end) {
+      void *block = bucket->bump;
+      bucket->bump += (index+1) * __ARC_POOL_GRAIN;
+      ++bucket->slabs->used;
+      return block;
+    }
+    // then see if other threads handed anything back, we only do this once
+    // the bump space runs dry so the walk is amortised over a whole slab
+    int collected = 0;
+    for (arc_pool_slab_t *slab = bucket->slabs; slab != NULL; slab = slab->next) {
+      // acquire pairs with the release push in __arc_pool_free, so the links
+      // written by the remote thread are visible before we walk them
+      void *head = atomic_exchange_explicit(&slab->remote, NULL, memory_order_acquire);
+      while (head != NULL) {
+        void *next = *(void **) head;
+        *(void **) head = bucket->free;
+        bucket->free = head;
+        --slab->used;
+        head = next;
+        collected = 1;
+      }
+    }
+    if (collected) {
+      continue;
+    }
+    // nope, time for a fresh slab... and the first one means we have slabs
+    // to give back when the thread exits
+    if (!__arc_pool_registered) {
+      pthread_once(&__arc_pool_once, __arc_pool_init);
+      if (pthread_setspecific(__arc_pool_key, __arc_pool_heap) != 0) {
+        return NULL;
+      }
+      __arc_pool_registered = 1;
+    }
+    arc_pool_slab_t *slab = aligned_alloc(ARC_POOL_SLAB_SIZE, ARC_POOL_SLAB_SIZE);
+    if (slab == NULL) {
       return NULL;
     }
-    // are we able to increment by 1?
+    slab->owner = __arc_self();
+    slab->next = bucket->slabs;
+    atomic_init(&slab->remote, NULL);
+    slab->block_size = (index+1) * __ARC_POOL_GRAIN;
+    slab->used = 0;
+    atomic_init(&slab->orphaned, 0);
+    bucket->slabs = slab;
+    bucket->bump = (uint8_t *) slab + __ARC_POOL_SLAB_HEADER_SIZE;
+    bucket->end = bucket->bump + \
+      (ARC_POOL_SLAB_SIZE - __ARC_POOL_SLAB_HEADER_SIZE) / slab->block_size * slab->block_size;
+  }
+}
+
+static void __arc_pool_free(void *block) {
+  arc_pool_slab_t *slab = __arc_pool_slab_of(block);
+  if (slab->owner == __arc_self()) {
+    // it's ours, straight back on the local list...
+    arc_pool_class_t *bucket = &__arc_pool_heap[slab->block_size / __ARC_POOL_GRAIN - 1];
+    *(void **) block = bucket->free;
+    bucket->free = block;
+    --slab->used;
+    return;
+  }
+  // someone else's, push it onto the slab for the owner to pick up later...
+  // release makes our link (and everything we did to the block) visible to
+  // the owner once it swaps the stack out
+  void *head = atomic_load_explicit(&slab->remote, memory_order_relaxed);
+  do {
+    if (head == &__arc_pool_orphan) {
+      // the owner is gone, and the last block home takes the slab with it
+      if (atomic_fetch_sub_explicit(&slab->orphaned, 1, memory_order_acq_rel) == 1) {
+        free(slab);
+      }
+      return;
+    }
+    *(void **) block = head;
+  } while (!atomic_compare_exchange_weak_explicit(
+    &slab->remote,
+    &head, block,
+    memory_order_release,
+    memory_order_relaxed)
+  );
+}
+
+#endif // ARC_POOL
+
+// shared memory regions hand out blocks to every process that maps them, at
+// whatever address each one mapped it, so nothing in the region may hold a
+// raw pointer -> the region keeps a bump pointer and a free list per power
+// of two size class, all counted in 16 byte granules from the region's start.
+// the lists are treiber stacks tagged against ABA, head = tag << 32 | granule,
+// and there isn't a lock anywhere, so a process dying halfway through never
+// leaves the others stuck... at worst its blocks (and refs) leak
+#define __ARC_SHM_GRAIN ((uint64_t) 16)
+#define __ARC_SHM_CLASSES 36
+
+static const uint64_t __ARC_SHM_MAGIC = 0x6172632d73686d31u;
+
+typedef struct arc_shm_region {
+  uint64_t magic;
+  uint64_t granules;
+  _Atomic uint64_t bump;
+  _Atomic uint64_t free[__ARC_SHM_CLASSES];
+} arc_shm_region_t;
+
+// prefix in front of every block in a region, how the free path gets back to
+// its region and list without anything but the block itself
+typedef struct arc_shm_block {
+  // next free block of the class while on a list
+  _Atomic uint32_t next;
+  uint32_t size_class;
+  uint64_t granule;
+} arc_shm_block_t;
+
+static uint8_t *__arc_shm_granule(arc_shm_region_t *region, uint64_t granule) {
+  return (uint8_t *) region + granule * __ARC_SHM_GRAIN;
+}
+
+static void *__arc_shm_alloc(void *ctx, size_t nbytes) {
+  arc_shm_region_t *region = ctx;
+  uint32_t size_class = 0;
+  while (size_class < __ARC_SHM_CLASSES && (__ARC_SHM_GRAIN << size_class) < nbytes) {
+    ++size_class;
+  }
+  if (size_class == __ARC_SHM_CLASSES) {
+    return NULL;
+  }
+  _Atomic uint64_t *list = &region->free[size_class];
+  // acquire pairs with the release push, so next is the one written for it
+  uint64_t head = atomic_load_explicit(list, memory_order_acquire);
+  while ((uint32_t) head != 0) {
+    arc_shm_block_t *block = (arc_shm_block_t *) __arc_shm_granule(region, (uint32_t) head);
+    // block may be popped (and reused) under us, the tag catches that...
+    uint32_t next = atomic_load_explicit(&block->next, memory_order_relaxed);
+    uint64_t popped = ((head >> 32) + 1) << 32 | next;
     if (atomic_compare_exchange_weak_explicit(
-      &header->strong_count,
-      &snapshot, snapshot + 1,
-      // we acquire memory effects released by decrement... any thread that
-      // successfully upgrades a weak can 'see' all writes made prior to
-      // final drop of last strong...
+      list,
+      &head, popped,
       memory_order_acquire,
-      memory_order_relaxed)
+      memory_order_acquire)
     ) {
-      // yup, success, a new arc can access the memory now...
-      void *arc_data = weak_data;
-      return arc_data;
+      return block;
     }
-    // once more round the sun...
   }
+  // nothing to recycle, carve off the end (if it fits, so one big ask can't
+  // strand the rest of the region)
+  uint64_t granules = (uint64_t) 1 << size_class;
+  uint64_t granule = atomic_load_explicit(&region->bump, memory_order_relaxed);
+  do {
+    if (granule + granules > region->granules || granule + granules > UINT32_MAX) {
+      return NULL;
+    }
+  } while (!atomic_compare_exchange_weak_explicit(
+    &region->bump,
+    &granule, granule + granules,
+    memory_order_relaxed,
+    memory_order_relaxed)
+  );
+  arc_shm_block_t *block = (arc_shm_block_t *) __arc_shm_granule(region, granule);
+  block->size_class = size_class;
+  block->granule = granule;
+  return block;
+}
+
+static void __arc_shm_free(void *ptr) {
+  arc_shm_block_t *block = ptr;
+  arc_shm_region_t *region = (arc_shm_region_t *)((uint8_t *) block - block->granule * __ARC_SHM_GRAIN);
+  _Atomic uint64_t *list = &region->free[block->size_class];
+  uint64_t head = atomic_load_explicit(list, memory_order_relaxed);
+  uint64_t pushed;
+  do {
+    atomic_store_explicit(&block->next, (uint32_t) head, memory_order_relaxed);
+    pushed = ((head >> 32) + 1) << 32 | block->granule;
+  } while (!atomic_compare_exchange_weak_explicit(
+    list,
+    &head, pushed,
+    memory_order_release,
+    memory_order_relaxed)
+  );
+}
+
+// ARC_USDT puts static tracepoints on the interesting edges of an arc's
+// life (arc:new, arc:free_last, weak:free_last, weak:upgrade_fail), for
+// bpftrace/perf/systemtap to hook at runtime... they cost a nop when nobody
+// is listening, but need <sys/sdt.h> (systemtap-sdt-dev) to build
+#ifdef ARC_USDT
+#if defined(__has_include) && __has_include(<sys/sdt.h>)
+#include <sys/sdt.h>
+#define __ARC_PROBE1(provider, name, a) DTRACE_PROBE1(provider, name, a)
+#define __ARC_PROBE2(provider, name, a, b) DTRACE_PROBE2(provider, name, a, b)
+#else
+#error "ARC_USDT needs <sys/sdt.h>"
+#endif
+#else
+#define __ARC_PROBE1(provider, name, a) ((void) 0)
+#define __ARC_PROBE2(provider, name, a, b) ((void) 0)
+#endif // ARC_USDT
+
+// ARC_SAMPLING picks one in every n allocations (counted per thread, so
+// deciding costs a relaxed load and a decrement) and records its stack in a
+// fixed ring of slots... the block keeps a pointer to its slot, and its last
+// weak stamps the time of death there. a slot is only ever reused once its
+// arc has died, so live arcs (the leak suspects) stay put however long they
+// live, and a sample that finds no room just goes unrecorded. slots are
+// seqlocks -> odd while being filled in, so arc_sample_dump can copy them
+// without stopping anyone
+#ifdef ARC_SAMPLING
+#if defined(__has_include) && __has_include(<execinfo.h>)
+#include <execinfo.h>
+#define __ARC_BACKTRACE(stack, depth) backtrace((stack), (int)(depth))
+#else
+#define __ARC_BACKTRACE(stack, depth) ((stack)[0] = __builtin_return_address(0), 1)
+#endif
+
+#ifndef ARC_SAMPLE_SLOTS
+#define ARC_SAMPLE_SLOTS ((size_t) 1024)
+#endif // ARC_SAMPLE_SLOTS
+
+// how many slots a sample looks at before giving up on finding a dead one
+static const size_t __ARC_SAMPLE_PROBES = 8;
+
+typedef struct arc_sample_slot {
+  _Atomic uint64_t seq;
+  // 0 for as long as the arc is alive
+  _Atomic uint64_t died_ns;
+  _Atomic uint64_t born_ns;
+  _Atomic(void *) arc_data;
+  _Atomic size_t nbytes;
+  _Atomic size_t depth;
+  _Atomic(void *) stack[ARC_SAMPLE_DEPTH];
+} arc_sample_slot_t;
+
+static arc_sample_slot_t __arc_samples[ARC_SAMPLE_SLOTS];
+static atomic_size_t __arc_sample_cursor;
+static atomic_size_t __arc_sample_rate;
+static _Thread_local size_t __arc_sample_countdown;
+
+static const size_t __ARC_SAMPLE_LEAD = sizeof(arc_sample_slot_t *);
+
+static uint64_t __arc_now_ns(void) {
+  struct timespec now;
+  clock_gettime(CLOCK_MONOTONIC, &now);
+  return (uint64_t) now.tv_sec * 1000000000u + (uint64_t) now.tv_nsec;
+}
+
+static int __arc_sample_due(void) {
+  size_t every = atomic_load_explicit(&__arc_sample_rate, memory_order_relaxed);
+  if (every == 0) {
+    return 0;
+  }
+  // also catches the rate coming down since we last looked
+  if (__arc_sample_countdown == 0 || __arc_sample_countdown > every) {
+    __arc_sample_countdown = every;
+  }
+  return --__arc_sample_countdown == 0;
+}
+
+static arc_sample_slot_t *__arc_sample_record(void *arc_data, size_t nbytes) {
+  for (size_t i = 0; i < __ARC_SAMPLE_PROBES; ++i) {
+    size_t at = atomic_fetch_add_explicit(&__arc_sample_cursor, 1, memory_order_relaxed);
+    arc_sample_slot_t *slot = &__arc_samples[at % ARC_SAMPLE_SLOTS];
+    uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_relaxed);
+    // someone's filling it in, or it's an arc that's still around...
+    if ((seq & 1) || (seq != 0 && atomic_load_explicit(&slot->died_ns, memory_order_acquire) == 0)) {
+      continue;
+    }
+    if (!atomic_compare_exchange_strong_explicit(&slot->seq, &seq, seq + 1, memory_order_relaxed, memory_order_relaxed)) {
+      continue;
+    }
+    atomic_thread_fence(memory_order_release);
+    void *stack[ARC_SAMPLE_DEPTH];
+    size_t depth = (size_t) __ARC_BACKTRACE(stack, ARC_SAMPLE_DEPTH);
+    for (size_t j = 0; j < depth; ++j) {
+      atomic_store_explicit(&slot->stack[j], stack[j], memory_order_relaxed);
+    }
+    atomic_store_explicit(&slot->depth, depth, memory_order_relaxed);
+    atomic_store_explicit(&slot->arc_data, arc_data, memory_order_relaxed);
+    atomic_store_explicit(&slot->nbytes, nbytes, memory_order_relaxed);
+    atomic_store_explicit(&slot->born_ns, __arc_now_ns(), memory_order_relaxed);
+    atomic_store_explicit(&slot->died_ns, 0, memory_order_relaxed);
+    atomic_store_explicit(&slot->seq, seq + 2, memory_order_release);
+    return slot;
+  }
+  return NULL;
+}
+
+static arc_sample_slot_t **__arc_sample_of(arc_header_t *header) {
+  return (arc_sample_slot_t **)((uint8_t *) header - __arc_offset(header) + __ARC_STATS_LEAD);
+}
+#endif // ARC_SAMPLING
+
+// grab a block with room for at least lead bytes of prefix, the header and
+// nbytes of data aligned to align, and hand back a pointer to the data (which
+// is all zeroes if zeroed is set)... rc says which family's stats it counts
+// towards, since nothing in the block (bar debug builds) tells an rc apart
+static void *__arc_alloc_as(int rc, const arc_allocator_t *allocator, size_t nbytes, size_t align, uint32_t flags, size_t lead, int zeroed) {
+#ifndef ARC_STATS
+  (void) rc;
+#else
+  lead += (flags & __ARC_FLAG_SHM) ? 0 : __ARC_STATS_LEAD;
+#endif // ARC_STATS
+#ifdef ARC_SAMPLING
+  // the slot pointer means nothing to another process...
+  if (!(flags & __ARC_FLAG_SHM) && __arc_sample_due()) {
+    flags |= __ARC_FLAG_SAMPLED;
+    lead += __ARC_SAMPLE_LEAD;
+  }
+#endif // ARC_SAMPLING
+  // blocks are always at least pointer aligned, as are the prefix and the
+  // header, so anything beyond that is the most padding we could need
+  size_t slack = align > sizeof(uintptr_t) ? align - sizeof(uintptr_t) : 0;
+  if (nbytes > SIZE_MAX - __ARC_HEADER_SIZE_WITH_PAD - sizeof(arc_meta_t) - lead - slack) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  flags |= slack > 0 ? __ARC_FLAG_ALIGNED : 0;
+  // anything with flags or a prefix of its own needs a meta to say so
+  size_t meta = flags != 0 || lead != __ARC_STATS_LEAD ? sizeof(arc_meta_t) : 0;
+  // calloc knows when its memory is fresh from the kernel and already zero,
+  // so big blocks skip the memset (and the page faults) entirely
+  int cleared = zeroed && allocator == &__ARC_LIBC_ALLOCATOR;
+#ifdef ARC_POOL
+  int pooled = allocator == &__ARC_LIBC_ALLOCATOR
+    && lead + meta + __ARC_HEADER_SIZE_WITH_PAD + nbytes + slack <= ARC_POOL_MAX_BLOCK;
+  flags |= pooled ? __ARC_FLAG_POOL : 0;
+  // (it's the heap arcs that aren't plain here...)
+  meta = flags != __ARC_FLAGS_PLAIN || lead != __ARC_STATS_LEAD ? sizeof(arc_meta_t) : 0;
+  lead += meta;
+  size_t total = lead + __ARC_HEADER_SIZE_WITH_PAD + nbytes + slack;
+  cleared = cleared && !pooled;
+  uint8_t *block = pooled ? __arc_pool_alloc(total)
+    : cleared ? calloc(1, total) : allocator->alloc(allocator->ctx, total);
+#else
+  lead += meta;
+  size_t total = lead + __ARC_HEADER_SIZE_WITH_PAD + nbytes + slack;
+  uint8_t *block = cleared ? calloc(1, total) : allocator->alloc(allocator->ctx, total);
+#endif // ARC_POOL
+  if (block == NULL) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  uintptr_t data = (uintptr_t)(block + lead + __ARC_HEADER_SIZE_WITH_PAD);
+  if (slack > 0) {
+    data = (data + align - 1) & ~(uintptr_t)(align - 1);
+  }
+  if (zeroed && !cleared) {
+    memset((void *) data, 0, nbytes);
+  }
+  arc_header_t *header = __get_header((void *) data);
+  __arc_init_counts(header);
+  if (meta > 0) {
+    __arc_init_meta(header, flags, (size_t)((uint8_t *) header - block));
+  }
+#ifdef ARC_STATS
+  if (!(flags & __ARC_FLAG_SHM)) {
+    *(size_t *) block = nbytes;
+    __ARC_STAT(rc ? __ARC_STAT_RC_ALLOCATIONS : __ARC_STAT_ALLOCATIONS, 1);
+    __ARC_STAT(rc ? __ARC_STAT_RC_BYTES_IN : __ARC_STAT_BYTES_IN, nbytes);
+  }
+#endif // ARC_STATS
+#ifdef ARC_SAMPLING
+  if (flags & __ARC_FLAG_SAMPLED) {
+    *__arc_sample_of(header) = __arc_sample_record((void *) data, nbytes);
+  }
+#endif // ARC_SAMPLING
+  __ARC_PROBE2(arc, new, (void *) data, nbytes);
+  return (void *) data;
+}
+
+static void *__arc_alloc(const arc_allocator_t *allocator, size_t nbytes, size_t align, uint32_t flags, size_t lead, int zeroed) {
+  return __arc_alloc_as(0, allocator, nbytes, align, flags, lead, zeroed);
+}
+
+// give the block behind header back to the allocator it came from, counting
+// it out of rc's family...
+static void __arc_release_as(int rc, arc_header_t *header) {
+#ifndef ARC_STATS
+  (void) rc;
+#else
+  if (!(__arc_flags(header) & __ARC_FLAG_SHM)) {
+    __ARC_STAT(rc ? __ARC_STAT_RC_FREES : __ARC_STAT_FREES, 1);
+    __ARC_STAT(rc ? __ARC_STAT_RC_BYTES_OUT : __ARC_STAT_BYTES_OUT, *(size_t *)((uint8_t *) header - __arc_offset(header)));
+  }
+#endif // ARC_STATS
+#ifdef ARC_SAMPLING
+  arc_sample_slot_t *slot = (__arc_flags(header) & __ARC_FLAG_SAMPLED) ? *__arc_sample_of(header) : NULL;
+  if (slot != NULL) {
+    atomic_store_explicit(&slot->died_ns, __arc_now_ns(), memory_order_release);
+  }
+#endif // ARC_SAMPLING
+  __ARC_PROBE1(weak, free_last, (uint8_t *) header + __ARC_HEADER_SIZE_WITH_PAD);
+#ifdef ARC_POOL
+  if (__arc_flags(header) & __ARC_FLAG_POOL) {
+    __arc_pool_free((uint8_t *) header - __arc_offset(header));
+    return;
+  }
+#endif // ARC_POOL
+  if (__arc_flags(header) & __ARC_FLAG_SHM) {
+    __arc_shm_free((uint8_t *) header - __arc_offset(header));
+    return;
+  }
+  const arc_allocator_t *allocator = __arc_allocator;
+  if (__arc_flags(header) & __ARC_FLAG_EXT) {
+    allocator = __get_ext(header)->allocator;
+  }
+  allocator->free(allocator->ctx, (uint8_t *) header - __arc_offset(header));
+}
+
+static void __arc_release(arc_header_t *header) {
+  __arc_release_as(0, header);
+}
+
+#ifdef ARC_POOL
+// room a pooled arc needs to leave the pool... a plain one isn't plain once
+// it's on the heap, and needs a meta to say so
+static size_t __arc_unpool_growth(arc_header_t *header) {
+  return __arc_prefixed(header) ? 0 : sizeof(arc_meta_t);
+}
+
+// copy the first copied bytes of a pooled arc's block into moved (which has
+// room for the growth), returning the header there
+static arc_header_t *__arc_unpool(arc_header_t *header, uint8_t *moved, size_t copied) {
+  size_t offset = __arc_offset(header);
+  uint8_t *block = (uint8_t *) header - offset;
+  if (__arc_prefixed(header)) {
+    memcpy(moved, block, copied);
+    arc_header_t *unpooled = (arc_header_t *)(moved + offset);
+    __get_meta(unpooled)->flags &= ~__ARC_FLAG_POOL;
+    return unpooled;
+  }
+  // everything from the header on moves up to make room for the meta
+  memcpy(moved, block, offset);
+  memcpy(moved + offset + sizeof(arc_meta_t), header, copied - offset);
+  arc_header_t *unpooled = (arc_header_t *)(moved + offset + sizeof(arc_meta_t));
+  __arc_init_meta(unpooled, 0, offset + sizeof(arc_meta_t));
+  return unpooled;
+}
+#endif // ARC_POOL
+
+// grow or shrink the block behind header to fit nbytes of data, keeping
+// everything from the start of the block on where it was relative to that
+// start (bar the meta a plain arc grows leaving the pool), and return the
+// header in the new block... the old data size is only known for ext arcs,
+// which is fine since anything from a custom allocator (the only ones that
+// might not realloc) has an ext
+static arc_header_t *__arc_resize(arc_header_t *header, size_t nbytes) {
+  size_t offset = __arc_offset(header);
+  uint8_t *block = (uint8_t *) header - offset;
+  size_t total = offset + __ARC_HEADER_SIZE_WITH_PAD + nbytes;
+#ifdef ARC_POOL
+  if (__arc_flags(header) & __ARC_FLAG_POOL) {
+    // slabs only come in fixed sizes, so this leaves the pool for the heap
+    size_t block_size = __arc_pool_slab_of(block)->block_size;
+    uint8_t *moved = malloc(total + __arc_unpool_growth(header));
+    if (moved == NULL) {
+      errno = ENOMEM;
+      return NULL;
+    }
+    arc_header_t *unpooled = __arc_unpool(header, moved, block_size < total ? block_size : total);
+    __arc_pool_free(block);
+    return unpooled;
+  }
+#endif // ARC_POOL
+  const arc_allocator_t *allocator = __arc_allocator;
+  if (__arc_flags(header) & __ARC_FLAG_EXT) {
+    allocator = __get_ext(header)->allocator;
+  }
+  if (allocator->realloc != NULL) {
+    uint8_t *moved = allocator->realloc(allocator->ctx, block, total);
+    if (moved == NULL) {
+      errno = ENOMEM;
+      return NULL;
+    }
+    return (arc_header_t *)(moved + offset);
+  }
+  if (!(__arc_flags(header) & __ARC_FLAG_EXT)) {
+    errno = ENOTSUP;
+    return NULL;
+  }
+  // no realloc, but we know how much there is, so do it the long way
+  size_t old = offset + __ARC_HEADER_SIZE_WITH_PAD + __get_ext(header)->nbytes;
+  uint8_t *moved = allocator->alloc(allocator->ctx, total);
+  if (moved == NULL) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  memcpy(moved, block, old < total ? old : total);
+  allocator->free(allocator->ctx, block);
+  return (arc_header_t *)(moved + offset);
+}
+
+// intern tables split their entries over ARC_INTERN_STRIPES independently
+// locked stripes, each a chained hash table of weaks that doubles as it fills
+#ifndef ARC_INTERN_STRIPES
+#define ARC_INTERN_STRIPES 16
+#endif // ARC_INTERN_STRIPES
+
+static const size_t __ARC_INTERN_BUCKETS = 8;
+
+typedef struct arc_intern_entry {
+  struct arc_intern_entry *next;
+  uint64_t hash;
+  size_t nbytes;
+  // the table's weak, which keeps the data readable even once it's dead
+  void *weak;
+} arc_intern_entry_t;
+
+typedef struct arc_intern_stripe {
+  pthread_mutex_t lock;
+  arc_intern_entry_t **buckets;
+  size_t capacity;
+  size_t count;
+  // a whole line of pad keeps neighbouring stripes off each other's lines,
+  // whatever the alignment of the block around us
+  char pad[ARC_CACHE_LINE_SIZE];
+} arc_intern_stripe_t;
+
+// the data of a sharded arc, which every interned arc holds a strong ref to,
+// so the table can't go before they do (and they don't all fight over one
+// count making or dropping it)
+struct arc_intern {
+  arc_intern_stripe_t stripes[ARC_INTERN_STRIPES];
+};
+
+// interned arcs remember their table and where in it they are, in front of
+// their ext...
+//   [arc_interned_t][arc_ext_t][arc_header_t][data]
+typedef struct arc_interned {
+  arc_intern_t *table;
+  uint64_t hash;
+} arc_interned_t;
+
+static arc_interned_t *__get_interned(arc_header_t *header) {
+  return (arc_interned_t *) __get_ext(header) - 1;
+}
+
+static arc_intern_stripe_t *__arc_intern_stripe(arc_intern_t *table, uint64_t hash) {
+  return &table->stripes[(hash >> 32) % ARC_INTERN_STRIPES];
+}
+
+static arc_intern_entry_t **__arc_intern_bucket(arc_intern_stripe_t *stripe, uint64_t hash) {
+  return &stripe->buckets[hash & (stripe->capacity - 1)];
+}
+
+// take the entry at link out of its (locked) stripe, dropping the table's weak
+static void __arc_intern_unlink(arc_intern_stripe_t *stripe, arc_intern_entry_t **link) {
+  arc_intern_entry_t *entry = *link;
+  *link = entry->next;
+  --stripe->count;
+  weak_free(entry->weak);
+  free(entry);
+}
+
+// the last strong to an interned arc is going, so it leaves the table now
+// rather than leaving a dead weak behind for a lookup to trip over... unless a
+// lookup already found it dead and beat us to it
+static void __arc_interned_forget(void *arc_data) {
+  arc_interned_t *interned = __get_interned(__get_header(arc_data));
+  arc_intern_t *table = interned->table;
+  arc_intern_stripe_t *stripe = __arc_intern_stripe(table, interned->hash);
+  pthread_mutex_lock(&stripe->lock);
+  for (arc_intern_entry_t **link = __arc_intern_bucket(stripe, interned->hash); *link != NULL; link = &(*link)->next) {
+    if ((*link)->weak == arc_data) {
+      __arc_intern_unlink(stripe, link);
+      break;
+    }
+  }
+  pthread_mutex_unlock(&stripe->lock);
+  arc_free(table, NULL);
+}
+
+// the last strong is gone, so we own the data and must now destroy it...
+// delegate responsibility of freeing the allocation to the weak pointer we
+// implicitly own
+static void __arc_destroy_now(void *arc_data, void(*destructor)(void *)) {
+  arc_header_t *header = __get_header(arc_data);
+  if (destructor == NULL && (__arc_flags(header) & __ARC_FLAG_EXT)) {
+    destructor = __get_ext(header)->destructor;
+  }
+  __ARC_PROBE1(arc, free_last, arc_data);
+  // before the destructor, so anything a lookup compares against is intact
+  if (__arc_flags(header) & __ARC_FLAG_INTERNED) {
+    __arc_interned_forget(arc_data);
+  }
+  if (destructor != NULL) {
+    destructor(arc_data);
+  }
+  // as noted, we now just free the symbolic weak we still hold
+  void *weak_data = arc_data;
+  weak_free(weak_data);
+}
+
+// borrowing is epoch based reclamation (see Fraser, "Practical lock-freedom")
+// -> a guard publishes the global epoch it started in, a last drop made while
+// anyone is borrowing goes on its thread's limbo list tagged with the epoch
+// it died in, and the epoch only moves on once every thread in a guard has
+// seen the current one. two moves past a drop and no guard can still see
+// it, and once nobody is borrowing at all none can... threads that exit with
+// drops in limbo leave them as orphans for whoever collects next
+#ifndef ARC_BORROW_BATCH
+#define ARC_BORROW_BATCH 64
+#endif // ARC_BORROW_BATCH
+
+typedef struct arc_retired {
+  struct arc_retired *next;
+  void *arc_data;
+  void(*destructor)(void *);
+  size_t epoch;
+} arc_retired_t;
+
+typedef struct arc_borrower {
+  // the epoch our outermost guard started in, 0 outside of one
+  _Alignas(ARC_CACHE_LINE_SIZE) atomic_size_t epoch;
+  size_t depth;
+  // only ever touched by the owning thread, or its key destructor
+  arc_retired_t *limbo;
+  size_t retired;
+  struct arc_borrower *next;
+} arc_borrower_t;
+
+// epochs start at 1, so 0 can mean not borrowing
+static atomic_size_t __arc_epoch = 1;
+// threads in a guard right now
+static atomic_size_t __arc_borrowing;
+// set for good once the first thread signs up to borrow, until which there
+// is no guard for a last drop to pair a fence with
+static atomic_int __arc_borrowed;
+static _Atomic(arc_retired_t *) __arc_orphans;
+static arc_borrower_t *__arc_borrowers;
+static pthread_mutex_t __arc_borrowers_lock = PTHREAD_MUTEX_INITIALIZER;
+static pthread_once_t __arc_borrow_once = PTHREAD_ONCE_INIT;
+static pthread_key_t __arc_borrow_key;
+static _Thread_local arc_borrower_t *__arc_borrower;
+
+static void __arc_borrow_retire(void *arg) {
+  arc_borrower_t *borrower = arg;
+  pthread_mutex_lock(&__arc_borrowers_lock);
+  arc_borrower_t **link = &__arc_borrowers;
+  while (*link != borrower) {
+    link = &(*link)->next;
+  }
+  *link = borrower->next;
+  pthread_mutex_unlock(&__arc_borrowers_lock);
+  if (borrower->limbo != NULL) {
+    arc_retired_t *last = borrower->limbo;
+    while (last->next != NULL) {
+      last = last->next;
+    }
+    last->next = atomic_load_explicit(&__arc_orphans, memory_order_relaxed);
+    while (!atomic_compare_exchange_weak_explicit(
+      &__arc_orphans,
+      &last->next, borrower->limbo,
+      memory_order_release,
+      memory_order_relaxed)
+    );
+  }
+  free(borrower);
+  __arc_borrower = NULL;
+}
+
+static const int __ARC_MEMBARRIER_QUERY = 0;
+static const int __ARC_MEMBARRIER_GLOBAL = 1 << 0;
+static const int __ARC_MEMBARRIER_PRIVATE_EXPEDITED = 1 << 3;
+static const int __ARC_MEMBARRIER_REGISTER_PRIVATE_EXPEDITED = 1 << 4;
+
+// how we ask the kernel for a membarrier, returning what the syscall does...
+// define it before including to stand in for the kernel
+#ifndef ARC_MEMBARRIER
+#ifdef SYS_membarrier
+#define ARC_MEMBARRIER(cmd) ((int) syscall(SYS_membarrier, (cmd), 0))
+#else
+#define ARC_MEMBARRIER(cmd) ((void)(cmd), errno = ENOSYS, -1)
+#endif // SYS_membarrier
+#endif // ARC_MEMBARRIER
+
+#ifndef ARC_BORROW_FENCE
+// with no membarrier to fence the drops that skipped theirs, there's nothing
+// for the first guard to lean on, so last drops keep their fence from the
+// start (as under ARC_BORROW_FENCE)... we ask as the library loads, before
+// there are threads dropping anything
+__attribute__((constructor)) static void __arc_borrow_probe(void) {
+  int cmds = ARC_MEMBARRIER(__ARC_MEMBARRIER_QUERY);
+  if (cmds < 0 || !(cmds & (__ARC_MEMBARRIER_PRIVATE_EXPEDITED | __ARC_MEMBARRIER_GLOBAL))) {
+    atomic_store_explicit(&__arc_borrowed, 1, memory_order_relaxed);
+  }
+}
+#endif // ARC_BORROW_FENCE
+
+static void __arc_borrow_init(void) {
+  pthread_key_create(&__arc_borrow_key, __arc_borrow_retire);
+  atomic_store_explicit(&__arc_borrowed, 1, memory_order_relaxed);
+#ifndef ARC_BORROW_FENCE
+  // a last drop that saw the flag unset made do without its fence, so have
+  // the kernel run one on every thread -> once it has, whatever they made
+  // unreachable before looking is visible to us, and any later look sees
+  // the flag (the private flavour is cheap, the global one a last resort)
+  if (ARC_MEMBARRIER(__ARC_MEMBARRIER_REGISTER_PRIVATE_EXPEDITED) == 0
+    && ARC_MEMBARRIER(__ARC_MEMBARRIER_PRIVATE_EXPEDITED) == 0
+  ) {
+    return;
+  }
+  if (ARC_MEMBARRIER(__ARC_MEMBARRIER_GLOBAL) == 0) {
+    return;
+  }
+  // the probe said we'd have one, but the kernel won't run it after all...
+  // the flag still puts the fence back on every last drop from here on, it
+  // just can't cover the ones already past it as we got here
+#endif // ARC_BORROW_FENCE
+}
+
+static arc_borrower_t *__arc_borrower_self(void) {
+  if (__arc_borrower != NULL) {
+    return __arc_borrower;
+  }
+  pthread_once(&__arc_borrow_once, __arc_borrow_init);
+  arc_borrower_t *borrower = aligned_alloc(ARC_CACHE_LINE_SIZE, sizeof(arc_borrower_t));
+  if (borrower == NULL || pthread_setspecific(__arc_borrow_key, borrower) != 0) {
+    free(borrower);
+    errno = ENOMEM;
+    return NULL;
+  }
+  atomic_init(&borrower->epoch, 0);
+  borrower->depth = 0;
+  borrower->limbo = NULL;
+  borrower->retired = 0;
+  pthread_mutex_lock(&__arc_borrowers_lock);
+  borrower->next = __arc_borrowers;
+  __arc_borrowers = borrower;
+  pthread_mutex_unlock(&__arc_borrowers_lock);
+  return __arc_borrower = borrower;
+}
+
+// move the epoch on if every guard has caught up with it, returning the
+// epoch as it now stands
+static size_t __arc_epoch_advance(void) {
+  size_t epoch = atomic_load_explicit(&__arc_epoch, memory_order_acquire);
+  pthread_mutex_lock(&__arc_borrowers_lock);
+  int behind = 0;
+  for (arc_borrower_t *borrower = __arc_borrowers; borrower != NULL && !behind; borrower = borrower->next) {
+    size_t seen = atomic_load_explicit(&borrower->epoch, memory_order_acquire);
+    behind = seen != 0 && seen != epoch;
+  }
+  pthread_mutex_unlock(&__arc_borrowers_lock);
+  if (!behind && atomic_compare_exchange_strong_explicit(&__arc_epoch, &epoch, epoch + 1, memory_order_acq_rel, memory_order_acquire)) {
+    ++epoch;
+  }
+  return epoch;
+}
+
+static size_t __arc_borrow_collect(arc_borrower_t *self) {
+  size_t epoch = __arc_epoch_advance();
+  // a guard starting after this can't reach anything that's in limbo
+  atomic_thread_fence(memory_order_seq_cst);
+  // (acquire pairs with the release as the last guard ended, so its reads
+  // are all done)
+  if (atomic_load_explicit(&__arc_borrowing, memory_order_acquire) == 0) {
+    epoch = SIZE_MAX;
+  }
+  arc_retired_t *orphans = atomic_exchange_explicit(&__arc_orphans, NULL, memory_order_acquire);
+  while (orphans != NULL) {
+    arc_retired_t *next = orphans->next;
+    orphans->next = self->limbo;
+    self->limbo = orphans;
+    ++self->retired;
+    orphans = next;
+  }
+  // unhook everything two epochs gone before destroying any of it, since
+  // destructors dropping last strongs of their own land back in limbo
+  arc_retired_t *ready = NULL;
+  arc_retired_t **link = &self->limbo;
+  while (*link != NULL) {
+    arc_retired_t *retired = *link;
+    if (epoch == SIZE_MAX || retired->epoch + 2 <= epoch) {
+      *link = retired->next;
+      retired->next = ready;
+      ready = retired;
+      --self->retired;
+    } else {
+      link = &retired->next;
+    }
+  }
+  size_t ran = 0;
+  while (ready != NULL) {
+    arc_retired_t *next = ready->next;
+    __arc_destroy_now(ready->arc_data, ready->destructor);
+    free(ready);
+    ready = next;
+    ++ran;
+  }
+  return ran;
+}
+
+static void __arc_borrow_defer(void *arc_data, void(*destructor)(void *)) {
+  arc_borrower_t *self = __arc_borrower_self();
+  arc_retired_t *retired = self != NULL ? malloc(sizeof(arc_retired_t)) : NULL;
+  if (retired == NULL) {
+    // nowhere to keep it, and leaking it beats freeing it out from under a
+    // reader... unless we can sit out the grace period right here
+    if (self != NULL && self->depth == 0) {
+      size_t until = atomic_load_explicit(&__arc_epoch, memory_order_acquire) + 2;
+      while (__arc_epoch_advance() < until) {
+        sched_yield();
+      }
+      __arc_destroy_now(arc_data, destructor);
+    }
+    return;
+  }
+  retired->arc_data = arc_data;
+  retired->destructor = destructor;
+  retired->epoch = atomic_load_explicit(&__arc_epoch, memory_order_acquire);
+  retired->next = self->limbo;
+  self->limbo = retired;
+  if (++self->retired >= ARC_BORROW_BATCH) {
+    __arc_borrow_collect(self);
+  }
+}
+
+// whether a last drop has any guard to pair a fence with... until anybody
+// has borrowed there isn't one, and the kernel fences us (see
+// __arc_borrow_init) should the first turn up right as we look
+static int __arc_borrow_seen(void) {
+#ifdef ARC_BORROW_FENCE
+  return 1;
+#else
+  atomic_signal_fence(memory_order_seq_cst);
+  return atomic_load_explicit(&__arc_borrowed, memory_order_relaxed);
+#endif // ARC_BORROW_FENCE
+}
+
+// whether a guard might still be reading something we just made unreachable
+static int __arc_borrow_guarded(void) {
+  if (!__arc_borrow_seen()) {
+    return 0;
+  }
+  // pairs with the fence in arc_borrow_begin, so either a new guard sees
+  // the arc already unreachable or we see that somebody is borrowing
+  atomic_thread_fence(memory_order_seq_cst);
+  return atomic_load_explicit(&__arc_borrowing, memory_order_acquire) > 0;
+}
+
+static void __arc_destroy(void *arc_data, void(*destructor)(void *)) {
+  if (__arc_borrow_guarded()) {
+    __arc_borrow_defer(arc_data, destructor);
+    return;
+  }
+  __arc_destroy_now(arc_data, destructor);
+  // and catch up on anything we left in limbo while others were borrowing
+  if (__arc_borrower != NULL && __arc_borrower->limbo != NULL) {
+    __arc_borrow_collect(__arc_borrower);
+  }
+}
+
+// biased arcs (see Choi, Shull & Torrellas, "Biased Reference Counting") keep
+// two counts -> the owning thread bumps a plain local count, everyone else
+// shares an atomic one. strong_count itself just sits at 1 the whole time the
+// two are in play, and only drops (like any other arc) once they merge and
+// add up to zero... the block looks like
+//   [arc_biased_t][arc_ext_t][arc_header_t][data]
+
+typedef struct arc_biased {
+  // the thread that made us, and the only one that may touch local/merged
+  size_t owner;
+  size_t local;
+  int merged;
+  // everyone else's refs, (count * __ARC_BIASED_ONE) | QUEUED | MERGED, where
+  // count goes negative when refs the owner made get dropped elsewhere
+  atomic_intptr_t shared;
+  // where to go when shared goes negative, and who destroys us if that
+  // ends up being the last word
+  struct arc_biased_queue *queue;
+  struct arc_biased *next;
+  void(*destructor)(void *);
+} arc_biased_t;
+
+// biased arcs that need an explicit merge by their owner, one per owning
+// thread and never freed (so it outlives its thread for anyone still pushing)
+typedef struct arc_biased_queue {
+  _Atomic(arc_biased_t *) head;
+  // the next retired queue, once our thread is gone
+  struct arc_biased_queue *next;
+} arc_biased_queue_t;
+
+// what an exiting owner leaves at the head of its queue, telling anyone who
+// would push after it to do the merge themselves...
+static arc_biased_t __arc_biased_retired;
+
+// queues of threads that have exited, kept about for the arcs still
+// pointing at them (and so nothing mistakes them for a leak)
+static _Atomic(arc_biased_queue_t *) __arc_biased_retired_queues;
+
+static const intptr_t __ARC_BIASED_MERGED = 1;
+static const intptr_t __ARC_BIASED_QUEUED = 2;
+static const intptr_t __ARC_BIASED_ONE = 4;
+
+static _Thread_local arc_biased_queue_t *__arc_biased_queue;
+static pthread_key_t __arc_biased_key;
+static pthread_once_t __arc_biased_once = PTHREAD_ONCE_INIT;
+
+static arc_biased_t *__get_biased(arc_header_t *header) {
+  return (arc_biased_t *) __get_ext(header) - 1;
+}
+
+static arc_header_t *__get_biased_header(arc_biased_t *biased) {
+  return __get_prefixed_header(biased + 1);
+}
+
+static intptr_t __arc_biased_count(intptr_t shared) {
+  return (shared - (shared & (__ARC_BIASED_ONE-1))) / __ARC_BIASED_ONE;
+}
+
+static int __arc_biased_is_owner(arc_biased_t *biased) {
+  return biased->owner == __arc_self() && !biased->merged;
+}
+
+// only the owner can tell, and only while every ref is its own... refs that
+// went elsewhere and came back still count against us until merged, which
+// errs on the side of a copy
+static int __arc_biased_unique(arc_header_t *header) {
+  arc_biased_t *biased = __get_biased(header);
+  return __arc_biased_is_owner(biased) && biased->local == 1
+    && atomic_load_explicit(&biased->shared, memory_order_acquire) == 0;
+}
+
+static void *__arc_biased_clone(arc_header_t *header, void *arc_data, size_t n) {
+  static const size_t max = __ARC_WEAK_MAX_REFS / __ARC_BIASED_ONE;
+  arc_biased_t *biased = __get_biased(header);
+  if (n > max) {
+    errno = ETOOMANYREFS;
+    return NULL;
+  }
+  if (__arc_biased_is_owner(biased)) {
+    // the whole point, no atomics on the owning thread...
+    if (biased->local > max - n) {
+      errno = ETOOMANYREFS;
+      return NULL;
+    }
+    biased->local += n;
+    return arc_data;
+  }
+  intptr_t snapshot = atomic_load_explicit(&biased->shared, memory_order_relaxed);
+  for (;;) {
+    intptr_t count = __arc_biased_count(snapshot);
+    // once merged, shared is the real count and zero means gone...
+    if ((snapshot & __ARC_BIASED_MERGED) && count == 0) {
+      errno = ENOENT;
+      return NULL;
+    }
+    if (count > (intptr_t)(max - n)) {
+      errno = ETOOMANYREFS;
+      return NULL;
+    }
+    // same as a plain clone or upgrade, acquire any decrement to 0 that
+    // snuck in since our load...
+    if (atomic_compare_exchange_weak_explicit(
+      &biased->shared,
+      &snapshot, snapshot + (intptr_t) n * __ARC_BIASED_ONE,
+      memory_order_acquire,
+      memory_order_relaxed)
+    ) {
+      return arc_data;
+    }
+    __ARC_RETRY(__ARC_OPS, __ARC_STAT_CLONE_RETRIES, "__arc_biased_clone");
+  }
+}
+
+// fold the owner's local count (less the drop refs it is letting go of) into
+// shared, returning true when the two added up to nothing and strong_count
+// should come down...
+static int __arc_biased_merge(arc_biased_t *biased, size_t drop) {
+  intptr_t local = (intptr_t) biased->local - (intptr_t) drop;
+  biased->local = 0;
+  biased->merged = 1;
+  // acquire everything released by the other threads decrements, and
+  // release ours for whoever ends up dropping the last ref after us
+  intptr_t prev = atomic_fetch_add_explicit(
+    &biased->shared, local * __ARC_BIASED_ONE + __ARC_BIASED_MERGED, memory_order_acq_rel
+  );
+  return __arc_biased_count(prev) + local == 0;
+}
+
+// returns true when the last biased refs went away...
+static int __arc_biased_release(arc_header_t *header, void(*destructor)(void *), size_t n) {
+  arc_biased_t *biased = __get_biased(header);
+  if (__arc_biased_is_owner(biased)) {
+    // only we can bring local down, and while it's above zero we know the
+    // arc is alive no matter what shared is doing...
+    if (biased->local > n) {
+      biased->local -= n;
+      return 0;
+    }
+    // any refs we drop past our local ones were counted in shared, so they
+    // come off as part of the merge
+    return __arc_biased_merge(biased, n);
+  }
+  intptr_t prev = atomic_fetch_sub_explicit(
+    &biased->shared, (intptr_t) n * __ARC_BIASED_ONE, memory_order_release
+  );
+  if (prev & __ARC_BIASED_MERGED) {
+    // merged means shared is the whole truth, same rules as a plain arc...
+    if (__arc_biased_count(prev) == (intptr_t) n) {
+      atomic_thread_fence(memory_order_acquire);
+      return 1;
+    }
+    return 0;
+  }
+  // not merged, so the owner still holds local refs and we cant be last...
+  // but if we just took shared negative, we dropped a ref the owner made,
+  // and the owner might never drop the rest locally -> ask it to merge
+  if (__arc_biased_count(prev) < (intptr_t) n && !(prev & __ARC_BIASED_QUEUED)) {
+    prev = atomic_fetch_or_explicit(&biased->shared, __ARC_BIASED_QUEUED, memory_order_relaxed);
+    if (!(prev & __ARC_BIASED_QUEUED)) {
+      // the owner may merge (and drop the last ref) between now and when it
+      // gets around to the queue, so the queue holds a weak to keep the
+      // block around until then
+      atomic_fetch_add_explicit(__ARC_WEAK(header), __ARC_UNIT(__ARC_WEAK_SHIFT), memory_order_relaxed);
+      biased->destructor = destructor;
+      biased->next = atomic_load_explicit(&biased->queue->head, memory_order_acquire);
+      do {
+        if (biased->next == &__arc_biased_retired) {
+          // the owner is gone and wont touch local again (acquired along
+          // with the tombstone), so merge on its behalf... the strong we
+          // just let go of keeps the block around, so the weak can't be last
+          atomic_fetch_sub_explicit(__ARC_WEAK(header), __ARC_UNIT(__ARC_WEAK_SHIFT), memory_order_relaxed);
+          return __arc_biased_merge(biased, 0);
+        }
+      } while (!atomic_compare_exchange_weak_explicit(
+        &biased->queue->head,
+        &biased->next, biased,
+        memory_order_release,
+        memory_order_acquire)
+      );
+    }
+  }
+  return 0;
+}
+
+static void *__arc_biased_upgrade(arc_header_t *header, void *weak_data) {
+  arc_biased_t *biased = __get_biased(header);
+  if (__arc_biased_is_owner(biased)) {
+    // not merged means local is above zero, so we are definitely alive
+    ++biased->local;
+    return weak_data;
+  }
+  // everyone else is cloning off of a possibly dead arc, which clone on the
+  // shared count already handles...
+  return __arc_biased_clone(header, weak_data, 1);
+}
+
+// sharded arcs (much like linux's percpu_ref) spread their strongs over a
+// row of counts a cache line apart, each thread sticking to one of them, and
+// keep strong_count at 1 the whole time, same as biased arcs do... the block
+// looks like
+//   [arc_sharded_t][arc_ext_t][arc_header_t][data]
+//
+// the real count is central plus every shard, and central never drops below
+// 1 while the shards are open -> a clone is a fetch_add on its own shard, a
+// free takes from its own shard when there's enough there, from central
+// otherwise, or failing that from whichever other shard the ref was counted
+// on (a ref cloned on one thread and freed on another), and only whoever
+// would take central down to nothing with no shard to borrow from closes the
+// shards instead, folding each into central (which carries a bias for the
+// duration, so none of the arcs being counted up can see it hit zero). from
+// then on central is all there is, and it behaves like any other count
+#ifndef ARC_SHARDS
+#define ARC_SHARDS 32
+#endif // ARC_SHARDS
+
+typedef struct arc_shard {
+  atomic_intptr_t count;
+  // a line apart, whatever the alignment of the block around us
+  char pad[ARC_CACHE_LINE_SIZE - sizeof(atomic_intptr_t)];
+} arc_shard_t;
+
+typedef struct arc_sharded {
+  arc_shard_t shards[ARC_SHARDS];
+  arc_shard_t central;
+} arc_sharded_t;
+
+// a closed shard reads negative, whatever clones pile onto it afterwards
+static const intptr_t __ARC_SHARD_CLOSED = INTPTR_MIN / 2;
+static const intptr_t __ARC_SHARD_BIAS = INTPTR_MAX / 4;
+
+static atomic_size_t __arc_shard_next;
+static _Thread_local size_t __arc_shard_slot = SIZE_MAX;
+
+static arc_sharded_t *__get_sharded(arc_header_t *header) {
+  return (arc_sharded_t *) __get_ext(header) - 1;
+}
+
+static atomic_intptr_t *__arc_shard_of(arc_sharded_t *sharded) {
+  // threads take slots round robin, so the first ARC_SHARDS get one each
+  if (__arc_shard_slot == SIZE_MAX) {
+    __arc_shard_slot = atomic_fetch_add_explicit(&__arc_shard_next, 1, memory_order_relaxed) % ARC_SHARDS;
+  }
+  return &sharded->shards[__arc_shard_slot].count;
+}
+
+static int __arc_sharded_unique(arc_header_t *header) {
+  // the last shard only closes once the fold is (all but) done, and central
+  // holding just 1 means the bias has come back out too
+  arc_sharded_t *sharded = __get_sharded(header);
+  return atomic_load_explicit(&sharded->shards[ARC_SHARDS - 1].count, memory_order_relaxed) < 0
+    && atomic_load_explicit(&sharded->central.count, memory_order_acquire) == 1;
+}
+
+static void *__arc_sharded_clone(arc_header_t *header, void *arc_data, size_t n) {
+  arc_sharded_t *sharded = __get_sharded(header);
+  // an open shard has the ref counted, and whoever closes it will fold it in
+  if (atomic_fetch_add_explicit(__arc_shard_of(sharded), (intptr_t) n, memory_order_relaxed) < 0) {
+    atomic_fetch_add_explicit(&sharded->central.count, (intptr_t) n, memory_order_relaxed);
+  }
+  return arc_data;
+}
+
+static void *__arc_sharded_upgrade(arc_header_t *header, void *weak_data) {
+  arc_sharded_t *sharded = __get_sharded(header);
+  // an open shard means nobody has finished closing up, so it's still alive
+  if (atomic_fetch_add_explicit(__arc_shard_of(sharded), 1, memory_order_acquire) >= 0) {
+    return weak_data;
+  }
+  intptr_t snapshot = atomic_load_explicit(&sharded->central.count, memory_order_relaxed);
+  for (;;) {
+    if (snapshot == 0) {
+      errno = ENOENT;
+      return NULL;
+    }
+    if (atomic_compare_exchange_weak_explicit(
+      &sharded->central.count,
+      &snapshot, snapshot + 1,
+      memory_order_acquire,
+      memory_order_relaxed)
+    ) {
+      return weak_data;
+    }
+    __ARC_RETRY(__ARC_OPS, __ARC_STAT_UPGRADE_RETRIES, "__arc_sharded_upgrade");
+  }
+}
+
+// take up to want off shard, returning how many it could spare, or -1 once
+// it's closed
+static intptr_t __arc_shard_take(atomic_intptr_t *shard, intptr_t want) {
+  intptr_t snapshot = atomic_load_explicit(shard, memory_order_relaxed);
+  while (snapshot > 0) {
+    intptr_t taken = snapshot < want ? snapshot : want;
+    if (atomic_compare_exchange_weak_explicit(shard, &snapshot, snapshot - taken, memory_order_release, memory_order_relaxed)) {
+      return taken;
+    }
+  }
+  return snapshot < 0 ? -1 : 0;
+}
+
+// drop n strongs, returning true when they were the last...
+static int __arc_sharded_release(arc_header_t *header, size_t n) {
+  arc_sharded_t *sharded = __get_sharded(header);
+  intptr_t drop = (intptr_t) n;
+  intptr_t taken = __arc_shard_take(__arc_shard_of(sharded), drop);
+  if (taken == drop) {
+    return 0;
+  }
+  atomic_intptr_t *central = &sharded->central.count;
+  if (taken < 0) {
+    // closed, so central is a plain old count
+    return atomic_fetch_sub_explicit(central, drop, memory_order_acq_rel) == drop;
+  }
+  // whatever our shard had is dropped already, so only the rest is left
+  drop -= taken;
+  intptr_t snapshot = atomic_load_explicit(central, memory_order_relaxed);
+  int borrowed = 0;
+  for (;;) {
+    if (snapshot > drop) {
+      if (atomic_compare_exchange_weak_explicit(central, &snapshot, snapshot - drop, memory_order_release, memory_order_relaxed)) {
+        return 0;
+      }
+      continue;
+    }
+    // central can't cover us, but the refs we're dropping might well be
+    // counted on other threads' shards (refs cloned there and freed here),
+    // a few on each... starting after our own, so threads borrowing at once
+    // don't all pile onto the first shard
+    if (!borrowed) {
+      borrowed = 1;
+      for (size_t i = 1; i < ARC_SHARDS && drop > 0; ++i) {
+        taken = __arc_shard_take(&sharded->shards[(__arc_shard_slot + i) % ARC_SHARDS].count, drop);
+        if (taken < 0) {
+          // someone's closing up already, and central has their bias on it
+          break;
+        }
+        drop -= taken;
+      }
+      if (drop == 0) {
+        return 0;
+      }
+      snapshot = atomic_load_explicit(central, memory_order_relaxed);
+      continue;
+    }
+    // this would be the end of central, time to close up shop...
+    if (atomic_compare_exchange_weak_explicit(central, &snapshot, snapshot + __ARC_SHARD_BIAS, memory_order_relaxed, memory_order_relaxed)) {
+      break;
+    }
+  }
+  for (size_t i = 0; i < ARC_SHARDS; ++i) {
+    intptr_t folded = atomic_exchange_explicit(&sharded->shards[i].count, __ARC_SHARD_CLOSED, memory_order_acq_rel);
+    if (folded > 0) {
+      atomic_fetch_add_explicit(central, folded, memory_order_relaxed);
+    }
+  }
+  return atomic_fetch_sub_explicit(central, __ARC_SHARD_BIAS + drop, memory_order_acq_rel) == __ARC_SHARD_BIAS + drop;
+}
+
+// traced arcs take part in cycle collection (see Bacon & Rajan, "Concurrent
+// Cycle Collection in Reference Counted Systems") and keep their count up in
+// a prefix, packed into one word along with a tally of every clone and free
+// they've had, so one load tells the collector whether anything moved...
+// strong_count sits at 1 the whole time, as for sharded arcs. the block looks
+// like
+//   [arc_traced_t][arc_ext_t][arc_header_t][data]
+//
+// a free that leaves the count above zero might just have left a cycle
+// holding itself up, so it parks the arc in the candidate buffer (with a weak
+// keeping the block around) on its way out, marking it buffered in the same
+// CAS as the decrement, so no free can find it buffered after the collector
+// has already looked at it without the collector knowing. the collector then trial-deletes
+// from the candidates -> mark gray everything they reach, taking each edge
+// between gray arcs off its target's count, blacken whatever still has refs
+// from outside along with all it reaches, and whatever is left white is only
+// held up by itself. each batch of candidates runs in a borrow guard of its
+// own, so nothing we walk over can be destroyed from under us, and a white arc
+// that was cloned or freed since we first looked might be held from outside
+// after all, so it goes back to black along with everything it reaches. only
+// the candidates that moved are looked at again, and only so many times
+// before they wait for the next go
+typedef struct arc_traced {
+  // tally of clones and frees (wrapping) up top, then whether it's sitting
+  // in the candidate buffer (holding its weak), then the count
+  _Atomic(uint64_t) state;
+  arc_trace_fn trace;
+  struct arc_traced *next;
+  // everything from here on is the collector's, under its lock
+  int color;
+  int collecting;
+  uint64_t seen;
+  // count left over once edges from other gray arcs are taken off
+  intptr_t trial;
+  struct arc_traced **edges;
+  size_t edge_count;
+  size_t edge_cap;
+  struct arc_traced *marked;
+  struct arc_traced *scan;
+} arc_traced_t;
+
+static const uint64_t __ARC_TRACED_OP = (uint64_t) 1 << 32;
+static const uint64_t __ARC_TRACED_BUFFERED = (uint64_t) 1 << 31;
+// half the count's bits, so a clone that overshoots and backs out can't
+// spill into the buffered bit
+static const uint64_t __ARC_TRACED_MAX_REFS = UINT32_MAX >> 2;
+
+enum {
+  __ARC_TRACED_NONE,
+  __ARC_TRACED_GRAY,
+  __ARC_TRACED_BLACK,
+};
+
+// how many candidates get trial-deleted under one borrow guard
+#ifndef ARC_COLLECT_BATCH
+#define ARC_COLLECT_BATCH ((size_t) 64)
+#endif // ARC_COLLECT_BATCH
+
+// how many goes a batch gets at the candidates that moved under it before
+// they're left for the next arc_collect_cycles
+#ifndef ARC_COLLECT_RETRIES
+#define ARC_COLLECT_RETRIES 3
+#endif // ARC_COLLECT_RETRIES
+
+typedef struct arc_collector {
+  _Atomic(arc_traced_t *) candidates;
+  pthread_mutex_t lock;
+  atomic_int running;
+  unsigned interval_us;
+  size_t budget;
+  pthread_t thread;
+} arc_collector_t;
+
+static arc_collector_t __arc_collector = {.lock = PTHREAD_MUTEX_INITIALIZER};
+
+static arc_traced_t *__get_traced(arc_header_t *header) {
+  return (arc_traced_t *) __get_ext(header) - 1;
+}
+
+static arc_header_t *__get_traced_header(arc_traced_t *traced) {
+  return __get_prefixed_header(traced + 1);
+}
+
+static void *__arc_traced_data(arc_traced_t *traced) {
+  return (uint8_t *) __get_traced_header(traced) + __ARC_HEADER_SIZE_WITH_PAD;
+}
+
+static uint64_t __arc_traced_count(uint64_t state) {
+  return state & (__ARC_TRACED_BUFFERED - 1);
+}
+
+static void __arc_traced_push(arc_traced_t *first, arc_traced_t *last) {
+  last->next = atomic_load_explicit(&__arc_collector.candidates, memory_order_relaxed);
+  while (!atomic_compare_exchange_weak_explicit(
+    &__arc_collector.candidates,
+    &last->next, first,
+    memory_order_release,
+    memory_order_relaxed)
+  );
+}
+
+static void *__arc_traced_clone(arc_header_t *header, void *arc_data, size_t n) {
+  arc_traced_t *traced = __get_traced(header);
+  if (n > __ARC_TRACED_MAX_REFS) {
+    errno = ETOOMANYREFS;
+    return NULL;
+  }
+  uint64_t state = atomic_fetch_add_explicit(&traced->state, __ARC_TRACED_OP + n, memory_order_relaxed);
+  if (__arc_traced_count(state) > __ARC_TRACED_MAX_REFS - n) {
+    // backing out still counts as a change, as far as the collector goes
+    atomic_fetch_add_explicit(&traced->state, __ARC_TRACED_OP - n, memory_order_relaxed);
+    errno = ETOOMANYREFS;
+    return NULL;
+  }
+  return arc_data;
+}
+
+// drop n strongs, returning true when they were the last...
+static int __arc_traced_release(arc_header_t *header, size_t n) {
+  arc_traced_t *traced = __get_traced(header);
+  void *arc_data = __arc_traced_data(traced);
+  uint64_t state = atomic_load_explicit(&traced->state, memory_order_relaxed);
+  int weak = 0;
+  int buffer;
+  for (;;) {
+    buffer = !(state & __ARC_TRACED_BUFFERED) && __arc_traced_count(state) > n;
+    // the buffer's weak has to be taken while our ref still keeps the block
+    // around... nobody hands out weaks to traced arcs, so it can't overflow
+    if (buffer && !weak) {
+      (void) __arc_weak_clone(header, arc_data);
+      weak = 1;
+    }
+    uint64_t next = state + __ARC_TRACED_OP - n + (buffer ? __ARC_TRACED_BUFFERED : 0);
+    // acquire pairs with the release as the collector let go of it, so it's
+    // done with next by the time we go near it
+    if (atomic_compare_exchange_weak_explicit(&traced->state, &state, next, memory_order_acq_rel, memory_order_relaxed)) {
+      break;
+    }
+  }
+  if (buffer) {
+    __arc_traced_push(traced, traced);
+  } else if (weak) {
+    weak_free(arc_data);
+  }
+  if (__arc_traced_count(state) != n) {
+    return 0;
+  }
+  atomic_thread_fence(memory_order_acquire);
+  // the collector takes care of whatever it's in the middle of destroying
+  return !traced->collecting;
+}
+
+typedef struct arc_trace_ctx {
+  arc_traced_t *from;
+  arc_traced_t ***tail;
+  int failed;
+} arc_trace_ctx_t;
+
+static void __arc_traced_mark(arc_traced_t *traced, arc_traced_t ***tail) {
+  if (traced->color != __ARC_TRACED_NONE) {
+    return;
+  }
+  traced->color = __ARC_TRACED_GRAY;
+  traced->seen = atomic_load_explicit(&traced->state, memory_order_acquire);
+  // an arc on its way out already might be mid destructor, so we keep off it,
+  // and it keeps everything after it alive for this time round
+  traced->trial = __arc_traced_count(traced->seen) > 0
+    ? (intptr_t) __arc_traced_count(traced->seen)
+    : INTPTR_MAX / 2;
+  traced->marked = NULL;
+  **tail = traced;
+  *tail = &traced->marked;
+}
+
+static void __arc_traced_visit(void *child, void *arg) {
+  arc_trace_ctx_t *ctx = arg;
+  arc_header_t *header = __get_header(child);
+  if (!(__arc_flags(header) & __ARC_FLAG_TRACED)) {
+    return;
+  }
+  arc_traced_t *from = ctx->from;
+  if (from->edge_count == from->edge_cap) {
+    size_t cap = from->edge_cap > 0 ? from->edge_cap * 2 : 4;
+    arc_traced_t **edges = realloc(from->edges, cap * sizeof(arc_traced_t *));
+    if (edges == NULL) {
+      ctx->failed = 1;
+      return;
+    }
+    from->edges = edges;
+    from->edge_cap = cap;
+  }
+  arc_traced_t *to = __get_traced(header);
+  from->edges[from->edge_count++] = to;
+  __arc_traced_mark(to, ctx->tail);
+}
+
+static void __arc_traced_blacken(arc_traced_t *traced) {
+  traced->color = __ARC_TRACED_BLACK;
+  traced->scan = NULL;
+  arc_traced_t *stack = traced;
+  while (stack != NULL) {
+    arc_traced_t *top = stack;
+    stack = top->scan;
+    for (size_t i = 0; i < top->edge_count; ++i) {
+      arc_traced_t *to = top->edges[i];
+      if (to->color != __ARC_TRACED_BLACK) {
+        to->color = __ARC_TRACED_BLACK;
+        to->scan = stack;
+        stack = to;
+      }
+    }
+  }
+}
+
+// trial-delete reachable from roots, returning how many arcs were destroyed,
+// or -1 if we ran out of memory and the roots need another go...
+static intptr_t __arc_collect(arc_traced_t *roots) {
+  arc_traced_t *marked = NULL;
+  arc_traced_t **tail = &marked;
+  for (arc_traced_t *root = roots; root != NULL; root = root->next) {
+    __arc_traced_mark(root, &tail);
+  }
+  // the marked list is its own work list, each trace adding on the end
+  arc_trace_ctx_t ctx = {NULL, &tail, 0};
+  for (arc_traced_t *traced = marked; traced != NULL && !ctx.failed; traced = traced->marked) {
+    if (__arc_traced_count(traced->seen) > 0) {
+      ctx.from = traced;
+      traced->trace(__arc_traced_data(traced), __arc_traced_visit, &ctx);
+    }
+  }
+  for (arc_traced_t *traced = marked; traced != NULL; traced = traced->marked) {
+    for (size_t i = 0; i < traced->edge_count; ++i) {
+      --traced->edges[i]->trial;
+    }
+  }
+  for (arc_traced_t *traced = marked; traced != NULL; traced = traced->marked) {
+    if (traced->trial > 0 && traced->color != __ARC_TRACED_BLACK) {
+      __arc_traced_blacken(traced);
+    }
+  }
+  // what's still gray is white... each of its refs has to be one of the edges
+  // we found, with nothing cloned or freed since, and whatever doesn't hold
+  // to that keeps everything it reaches alive this time round
+  for (arc_traced_t *traced = marked; traced != NULL; traced = traced->marked) {
+    if (traced->color == __ARC_TRACED_GRAY && (traced->trial != 0
+      || atomic_load_explicit(&traced->state, memory_order_acquire) != traced->seen)) {
+      __arc_traced_blacken(traced);
+    }
+  }
+  arc_traced_t *white = NULL;
+  size_t whites = 0;
+  for (arc_traced_t *traced = marked; traced != NULL; traced = traced->marked) {
+    if (traced->color == __ARC_TRACED_GRAY) {
+      traced->scan = white;
+      white = traced;
+      ++whites;
+    }
+  }
+  arc_traced_t *traced = marked;
+  while (traced != NULL) {
+    arc_traced_t *next = traced->marked;
+    free(traced->edges);
+    traced->edges = NULL;
+    traced->edge_count = traced->edge_cap = 0;
+    traced->color = __ARC_TRACED_NONE;
+    traced = next;
+  }
+  if (ctx.failed) {
+    return -1;
+  }
+  // every destructor runs before any block goes, since they drop refs to
+  // each other... and the last of those mustn't destroy anything twice
+  for (traced = white; traced != NULL; traced = traced->scan) {
+    traced->collecting = 1;
+  }
+  for (traced = white; traced != NULL; traced = traced->scan) {
+    void *arc_data = __arc_traced_data(traced);
+    void(*destructor)(void *) = __get_ext(__get_traced_header(traced))->destructor;
+    __ARC_PROBE1(arc, free_last, arc_data);
+    if (destructor != NULL) {
+      destructor(arc_data);
+    }
+  }
+  traced = white;
+  while (traced != NULL) {
+    arc_traced_t *next = traced->scan;
+    __arc_drop_strong(__get_traced_header(traced));
+    weak_free(__arc_traced_data(traced));
+    traced = next;
+  }
+  return (intptr_t) whites;
+}
+
+// let go of a root, unless it moved since we looked (which might have been
+// the free that matters, one that found it buffered) and needs another go
+static int __arc_traced_unbuffer(arc_traced_t *traced) {
+  uint64_t state = atomic_load_explicit(&traced->state, memory_order_relaxed);
+  do {
+    if (__arc_traced_count(state) > 0 && state / __ARC_TRACED_OP != traced->seen / __ARC_TRACED_OP) {
+      return 0;
+    }
+  } while (!atomic_compare_exchange_weak_explicit(
+    &traced->state,
+    &state, state & ~__ARC_TRACED_BUFFERED,
+    memory_order_release,
+    memory_order_relaxed)
+  );
+  return 1;
+}
+
+// put roots back in the candidate buffer, weaks and all
+static void __arc_traced_requeue(arc_traced_t *roots) {
+  if (roots == NULL) {
+    return;
+  }
+  arc_traced_t *last = roots;
+  while (last->next != NULL) {
+    last = last->next;
+  }
+  __arc_traced_push(roots, last);
+}
+
+// let go of every root that stayed put, handing back the ones that moved
+static arc_traced_t *__arc_traced_settle(arc_traced_t *roots) {
+  arc_traced_t *moved = NULL;
+  while (roots != NULL) {
+    arc_traced_t *next = roots->next;
+    if (__arc_traced_unbuffer(roots)) {
+      weak_free(__arc_traced_data(roots));
+    } else {
+      roots->next = moved;
+      moved = roots;
+    }
+    roots = next;
+  }
+  return moved;
+}
+
+// cut up to n roots off the front of *roots
+static arc_traced_t *__arc_traced_take(arc_traced_t **roots, size_t n) {
+  arc_traced_t *first = *roots;
+  if (first == NULL) {
+    return NULL;
+  }
+  arc_traced_t *last = first;
+  for (size_t i = 1; i < n && last->next != NULL; ++i) {
+    last = last->next;
+  }
+  *roots = last->next;
+  last->next = NULL;
+  return first;
+}
+
+static void *__arc_collector_main(void *arg) {
+  (void) arg;
+  unsigned interval_us = __arc_collector.interval_us;
+  struct timespec interval = {
+    interval_us / 1000000, (long)(interval_us % 1000000) * 1000
+  };
+  while (atomic_load_explicit(&__arc_collector.running, memory_order_acquire)) {
+    arc_collect_cycles(__arc_collector.budget);
+    nanosleep(&interval, NULL);
+  }
+  return NULL;
+}
+
+// deferred destruction is a treiber stack of (data, destructor) pairs...
+// producers push one at a time, consumers swap out the whole stack at once,
+// so there is no ABA to worry about, and any number of threads can drain
+
+typedef struct arc_deferred {
+  struct arc_deferred *next;
+  void *arc_data;
+  void(*destructor)(void *);
+} arc_deferred_t;
+
+typedef struct arc_reclaimer {
+  _Atomic(arc_deferred_t *) head;
+  arc_reclaimer_opts_t opts;
+  atomic_int running;
+  pthread_t thread;
+} arc_reclaimer_t;
+
+static arc_reclaimer_t __arc_reclaimer;
+
+static void __arc_defer_push(arc_deferred_t *first, arc_deferred_t *last) {
+  last->next = atomic_load_explicit(&__arc_reclaimer.head, memory_order_relaxed);
+  // release so the consumer sees the nodes (and everything the dropping
+  // thread did to the data before letting go)
+  while (!atomic_compare_exchange_weak_explicit(
+    &__arc_reclaimer.head,
+    &last->next, first,
+    memory_order_release,
+    memory_order_relaxed)
+  );
+}
+
+static void __arc_defer(void *arc_data, void(*destructor)(void *)) {
+  arc_deferred_t *deferred = malloc(sizeof(arc_deferred_t));
+  if (deferred == NULL) {
+    // no room to queue it, so we're back to doing it the slow way...
+    __arc_destroy(arc_data, destructor);
+    return;
+  }
+  deferred->arc_data = arc_data;
+  deferred->destructor = destructor;
+  __arc_defer_push(deferred, deferred);
+}
+
+static void *__arc_reclaimer_main(void *arg) {
+  (void) arg;
+  unsigned interval_us = __arc_reclaimer.opts.interval_us;
+  struct timespec interval = {
+    interval_us / 1000000, (long)(interval_us % 1000000) * 1000
+  };
+  while (atomic_load_explicit(&__arc_reclaimer.running, memory_order_acquire)) {
+    if (arc_reclaimer_drain() == 0) {
+      nanosleep(&interval, NULL);
+    }
+  }
+  return NULL;
+}
+
+// arc_atomic_t is a split count... the word in the slot is the arc's address
+// with a count of readers who have pinned it packed up above the address, a
+// reader bumps that count, clones the arc for real, then takes its pin back
+// out. a pin is paid for up front -> the slot holds __ARC_ATOMIC_MAX_PINS
+// strongs on top of its own, and whoever replaces the arc keeps one of those
+// for every pin still in the word, handing back the rest. a reader who finds
+// its arc gone drops one of the kept ones instead... since they were there
+// before the pin was ever taken, the count can never dip to zero under a
+// reader, however the swap and the unpin interleave. addresses get 48 bits on 64-bit
+// targets (which is what user space gets on everything but 5-level paging),
+// the full 32 elsewhere, and the pin count whatever is left over
+#if UINTPTR_MAX > 0xFFFFFFFFu
+static const unsigned __ARC_ATOMIC_PTR_BITS = 48;
+#else
+static const unsigned __ARC_ATOMIC_PTR_BITS = 32;
+#endif
+
+static const size_t __ARC_ATOMIC_MAX_PINS = 0xFFFF;
+
+#define __ARC_ATOMIC_PIN ((uint64_t) 1 << __ARC_ATOMIC_PTR_BITS)
+#define __ARC_ATOMIC_PTR_MASK (__ARC_ATOMIC_PIN - 1)
+
+static void *__arc_atomic_ptr(uint64_t word) {
+  return (void *)(uintptr_t)(word & __ARC_ATOMIC_PTR_MASK);
+}
+
+static size_t __arc_atomic_pins(uint64_t word) {
+  return (size_t)(word >> __ARC_ATOMIC_PTR_BITS);
+}
+
+// (__arc_atomic_reserve has already turned away anything that doesn't fit)
+static uint64_t __arc_atomic_word(void *arc_data) {
+  return (uint64_t)(uintptr_t) arc_data;
+}
+
+// an arc is going into a slot, so reserve the strongs its pins will need,
+// returning 0, or -1 and errno if its count hasn't room for them... or if
+// its address won't fit beneath the pins, which would otherwise lose its
+// top bits (and corrupt the pins with them) without a word
+static int __arc_atomic_reserve(void *arc_data) {
+  if (((uint64_t)(uintptr_t) arc_data & ~__ARC_ATOMIC_PTR_MASK) != 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  if (arc_data != NULL && arc_clone_n(arc_data, __ARC_ATOMIC_MAX_PINS) == NULL) {
+    return -1;
+  }
+  return 0;
+}
+
+// an arc just came out of a slot, so keep the reserved strongs readers still
+// hold pins against and hand back the rest... returns the arc, holding the
+// slot's own ref (which keeps this from ever being the last drop)
+static void *__arc_atomic_unpin(uint64_t word) {
+  void *arc_data = __arc_atomic_ptr(word);
+  size_t pins = __arc_atomic_pins(word);
+  if (arc_data != NULL && pins < __ARC_ATOMIC_MAX_PINS) {
+    arc_free_n(arc_data, __ARC_ATOMIC_MAX_PINS - pins, NULL);
+  }
+  return arc_data;
+}
+
+// then comes the public api...
+
+void arc_set_allocator(const arc_allocator_t *allocator) {
+  __arc_allocator = allocator != NULL ? allocator : &__ARC_LIBC_ALLOCATOR;
+}
+
+void *arc_new(size_t nbytes) {
+  if (nbytes == 0) {
+    return NULL;
+  }
+  // too big to be worth fragmenting the heap over...
+  if (ARC_MAP_THRESHOLD != 0 && nbytes >= ARC_MAP_THRESHOLD && __arc_allocator == &__ARC_LIBC_ALLOCATOR) {
+    return arc_new_mapped(nbytes, ARC_MAP_THP);
+  }
+  return __arc_alloc(__arc_allocator, nbytes, sizeof(uintptr_t), 0, 0, 0);
+}
+
+void *arc_new_mapped(size_t nbytes, unsigned flags) {
+  if (nbytes == 0) {
+    return NULL;
+  }
+  if (flags >= sizeof(__ARC_MAP_MODES) / sizeof(__ARC_MAP_MODES[0])) {
+    errno = EINVAL;
+    return NULL;
+  }
+  const arc_allocator_t *allocator = &__ARC_MAP_ALLOCATORS[flags];
+  void *data = __arc_alloc(allocator, nbytes, sizeof(uintptr_t), __ARC_FLAG_EXT, sizeof(arc_ext_t), 0);
+  if (data == NULL) {
+    return NULL;
+  }
+  __arc_ext_init(__get_header(data), allocator, nbytes, NULL);
+  return data;
+}
+
+void *arc_map_file(const char *path, size_t *nbytes) {
+  int fd = open(path, O_RDONLY | O_CLOEXEC);
+  if (fd < 0) {
+    return NULL;
+  }
+  struct stat info;
+  if (fstat(fd, &info) != 0) {
+    int error = errno;
+    close(fd);
+    errno = error;
+    return NULL;
+  }
+  // nothing to map, or nothing with a size we could map
+  if (!S_ISREG(info.st_mode) || info.st_size == 0) {
+    close(fd);
+    errno = EINVAL;
+    return NULL;
+  }
+  size_t size = (size_t) info.st_size;
+  // page aligned data puts the header at the tail of the page before it, and
+  // the file then goes right over the anonymous pages holding the data
+  const arc_allocator_t *allocator = &__ARC_MAP_ALLOCATORS[0];
+  void *data = __arc_alloc(allocator, size, __arc_page_size(), __ARC_FLAG_EXT, sizeof(arc_ext_t), 0);
+  if (data == NULL) {
+    close(fd);
+    return NULL;
+  }
+  arc_header_t *header = __get_header(data);
+  __arc_ext_init(header, allocator, size, NULL);
+  if (mmap(data, size, PROT_READ, MAP_PRIVATE | MAP_FIXED, fd, 0) == MAP_FAILED) {
+    int error = errno;
+    close(fd);
+    __arc_release(header);
+    errno = error;
+    return NULL;
+  }
+  // the mapping keeps the file alive on its own
+  close(fd);
+  __get_meta(header)->flags |= __ARC_FLAG_READONLY;
+  if (nbytes != NULL) {
+    *nbytes = size;
+  }
+  return data;
+}
+
+const arc_allocator_t *arc_node_allocator(int node) {
+  if (node < ARC_NODE_LOCAL || node >= ARC_MAX_NODES) {
+    errno = EINVAL;
+    return NULL;
+  }
+  pthread_once(&__arc_nodes_once, __arc_nodes_init);
+  return &__arc_node_allocators[node + 1];
+}
+
+void *arc_new_on_node(size_t nbytes, int node) {
+  const arc_allocator_t *allocator = arc_node_allocator(node);
+  return allocator != NULL ? arc_new_in(allocator, nbytes) : NULL;
+}
+
+int arc_node_of(void *arc_data) {
+#ifdef SYS_get_mempolicy
+  int node = -1;
+  if (syscall(SYS_get_mempolicy, &node, NULL, 0ul, arc_data, __ARC_MPOL_F_NODE | __ARC_MPOL_F_ADDR) != 0) {
+    return -1;
+  }
+  return node;
+#else
+  (void) arc_data;
+  errno = ENOSYS;
+  return -1;
+#endif // SYS_get_mempolicy
+}
+
+int arc_current_node(void) {
+#ifdef SYS_getcpu
+  unsigned cpu, node;
+  if (syscall(SYS_getcpu, &cpu, &node, NULL) != 0) {
+    return -1;
+  }
+  return (int) node;
+#else
+  errno = ENOSYS;
+  return -1;
+#endif // SYS_getcpu
+}
+
+void *arc_new_zeroed(size_t nbytes) {
+  if (nbytes == 0) {
+    return NULL;
+  }
+  return __arc_alloc(__arc_allocator, nbytes, sizeof(uintptr_t), 0, 0, 1);
+}
+
+void *arc_from_copy(const void *src, size_t nbytes) {
+  void *data = arc_new(nbytes);
+  if (data != NULL) {
+    memcpy(data, src, nbytes);
+  }
+  return data;
+}
+
+void *arc_new_array(size_t count, size_t elem_size) {
+  return arc_new_array_with_dtor(count, elem_size, NULL);
+}
+
+void *arc_new_array_with_dtor(size_t count, size_t elem_size, void(*elem_destructor)(void *)) {
+  if (count == 0 || elem_size == 0) {
+    return NULL;
+  }
+  if (count > SIZE_MAX / elem_size) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  size_t nbytes = count * elem_size;
+  void *data = __arc_alloc(
+    __arc_allocator, nbytes, sizeof(uintptr_t), __ARC_FLAG_EXT | __ARC_FLAG_ARRAY,
+    sizeof(arc_array_t) + sizeof(arc_ext_t), 0
+  );
+  if (data == NULL) {
+    return NULL;
+  }
+  arc_header_t *header = __get_header(data);
+  __arc_ext_init(header, __arc_allocator, nbytes, elem_destructor != NULL ? __arc_array_destroy : NULL);
+  arc_array_t *array = __get_array(header);
+  array->count = count;
+  array->elem_size = elem_size;
+  array->elem_destructor = elem_destructor;
+  return data;
+}
+
+size_t arc_array_len(void *arc_data) {
+  arc_header_t *header = __get_header(arc_data);
+  return (__arc_flags(header) & __ARC_FLAG_ARRAY) ? __get_array(header)->count : 0;
+}
+
+void *arc_new_aligned(size_t nbytes, size_t align) {
+  if (nbytes == 0) {
+    return NULL;
+  }
+  // header offsets are 32 bits, which is plenty for any sane alignment...
+  if (align == 0 || (align & (align - 1)) != 0 || align > ((size_t) 1 << 30)) {
+    errno = EINVAL;
+    return NULL;
+  }
+  return __arc_alloc(__arc_allocator, nbytes, align, 0, 0, 0);
+}
+
+void *arc_new_isolated(size_t nbytes) {
+  if (nbytes == 0) {
+    return NULL;
+  }
+  if (nbytes > SIZE_MAX - ARC_CACHE_LINE_SIZE) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  // aligning the data to a line puts the header at the tail of the line
+  // before it, reserving a whole line of lead guarantees nobody else's data
+  // shares that line with the header, and rounding the data up to whole
+  // lines keeps the next allocation off our last one...
+  size_t lines = (nbytes + ARC_CACHE_LINE_SIZE - 1) & ~(ARC_CACHE_LINE_SIZE - 1);
+  return __arc_alloc(
+    __arc_allocator, lines, ARC_CACHE_LINE_SIZE, 0,
+    ARC_CACHE_LINE_SIZE - __ARC_HEADER_SIZE_WITH_PAD, 0
+  );
+}
+
+void *arc_new_in(const arc_allocator_t *allocator, size_t nbytes) {
+  if (allocator == NULL) {
+    return arc_new(nbytes);
+  }
+  if (nbytes == 0) {
+    return NULL;
+  }
+  void *data = __arc_alloc(allocator, nbytes, sizeof(uintptr_t), __ARC_FLAG_EXT, sizeof(arc_ext_t), 0);
+  if (data == NULL) {
+    return NULL;
+  }
+  // remember where we came from, weak_free needs to know on the way out...
+  __arc_ext_init(__get_header(data), allocator, nbytes, NULL);
+  return data;
+}
+
+void *arc_new_with_dtor(size_t nbytes, void(*destructor)(void *)) {
+  if (nbytes == 0) {
+    return NULL;
+  }
+  void *data = __arc_alloc(__arc_allocator, nbytes, sizeof(uintptr_t), __ARC_FLAG_EXT, sizeof(arc_ext_t), 0);
+  if (data == NULL) {
+    return NULL;
+  }
+  __arc_ext_init(__get_header(data), __arc_allocator, nbytes, destructor);
+  return data;
+}
+
+// merge everything queue handed us, destroying whatever that was the end of
+static void __arc_biased_drain(arc_biased_t *biased) {
+  while (biased != NULL) {
+    arc_biased_t *next = biased->next;
+    arc_header_t *header = __get_biased_header(biased);
+    void *data = (uint8_t *) header + __ARC_HEADER_SIZE_WITH_PAD;
+    if (!biased->merged && __arc_biased_merge(biased, 0) && __arc_drop_strong(header)) {
+      __arc_destroy(data, biased->destructor);
+    }
+    // and let go of the weak the queue was holding...
+    weak_free(data);
+    biased = next;
+  }
+}
+
+// an owner on its way out can't merge anything anymore, so take everything
+// already queued and leave the tombstone for later pushers in its place...
+static void __arc_biased_retire(void *arg) {
+  arc_biased_queue_t *queue = arg;
+  // draw a fresh identity first -> once the tombstone is up others are free
+  // to merge our arcs, so anything freed from here on (our own drain's
+  // destructors included) has to stay off of local
+  __arc_thread_id = 0;
+  __arc_biased_drain(atomic_exchange_explicit(&queue->head, &__arc_biased_retired, memory_order_acq_rel));
+  __arc_biased_queue = NULL;
+  queue->next = atomic_load_explicit(&__arc_biased_retired_queues, memory_order_relaxed);
+  while (!atomic_compare_exchange_weak_explicit(
+    &__arc_biased_retired_queues,
+    &queue->next, queue,
+    memory_order_relaxed,
+    memory_order_relaxed)
+  );
+}
+
+static void __arc_biased_init(void) {
+  pthread_key_create(&__arc_biased_key, __arc_biased_retire);
+}
+
+void *arc_new_biased(size_t nbytes) {
+  if (nbytes == 0) {
+    return NULL;
+  }
+  // good a time as any to catch up on merges...
+  arc_biased_poll();
+  if (__arc_biased_queue == NULL) {
+    pthread_once(&__arc_biased_once, __arc_biased_init);
+    arc_biased_queue_t *queue = malloc(sizeof(arc_biased_queue_t));
+    if (queue == NULL) {
+      return NULL;
+    }
+    atomic_init(&queue->head, NULL);
+    queue->next = NULL;
+    if (pthread_setspecific(__arc_biased_key, queue) != 0) {
+      free(queue);
+      errno = ENOMEM;
+      return NULL;
+    }
+    __arc_biased_queue = queue;
+  }
+  void *data = __arc_alloc(
+    __arc_allocator, nbytes, sizeof(uintptr_t), __ARC_FLAG_EXT | __ARC_FLAG_BIASED,
+    sizeof(arc_biased_t) + sizeof(arc_ext_t), 0
+  );
+  if (data == NULL) {
+    return NULL;
+  }
+  arc_header_t *header = __get_header(data);
+  __arc_ext_init(header, __arc_allocator, nbytes, NULL);
+  arc_biased_t *biased = __get_biased(header);
+  biased->owner = __arc_self();
+  biased->local = 1;
+  biased->merged = 0;
+  atomic_init(&biased->shared, 0);
+  biased->queue = __arc_biased_queue;
+  biased->next = NULL;
+  biased->destructor = NULL;
+  return data;
+}
+
+void *arc_new_sharded(size_t nbytes) {
+  if (nbytes == 0) {
+    return NULL;
+  }
+  void *data = __arc_alloc(
+    __arc_allocator, nbytes, sizeof(uintptr_t), __ARC_FLAG_EXT | __ARC_FLAG_SHARDED,
+    sizeof(arc_sharded_t) + sizeof(arc_ext_t), 0
+  );
+  if (data == NULL) {
+    return NULL;
+  }
+  arc_header_t *header = __get_header(data);
+  __arc_ext_init(header, __arc_allocator, nbytes, NULL);
+  arc_sharded_t *sharded = __get_sharded(header);
+  for (size_t i = 0; i < ARC_SHARDS; ++i) {
+    atomic_init(&sharded->shards[i].count, 0);
+  }
+  // the ref we're handing back
+  atomic_init(&sharded->central.count, 1);
+  return data;
+}
+
+void *arc_new_traced(size_t nbytes, arc_trace_fn trace, void(*destructor)(void *)) {
+  if (nbytes == 0) {
+    return NULL;
+  }
+  if (trace == NULL) {
+    errno = EINVAL;
+    return NULL;
+  }
+  void *data = __arc_alloc(
+    __arc_allocator, nbytes, sizeof(uintptr_t), __ARC_FLAG_EXT | __ARC_FLAG_TRACED,
+    sizeof(arc_traced_t) + sizeof(arc_ext_t), 0
+  );
+  if (data == NULL) {
+    return NULL;
+  }
+  arc_header_t *header = __get_header(data);
+  __arc_ext_init(header, __arc_allocator, nbytes, destructor);
+  arc_traced_t *traced = __get_traced(header);
+  // the ref we're handing back
+  atomic_init(&traced->state, 1);
+  traced->trace = trace;
+  traced->next = NULL;
+  traced->color = __ARC_TRACED_NONE;
+  traced->collecting = 0;
+  traced->seen = 0;
+  traced->trial = 0;
+  traced->edges = NULL;
+  traced->edge_count = 0;
+  traced->edge_cap = 0;
+  traced->marked = NULL;
+  traced->scan = NULL;
+  return data;
+}
+
+void arc_biased_poll(void) {
+  if (__arc_biased_queue == NULL) {
+    return;
+  }
+  // we're the only ones popping, and we take everything, so no ABA...
+  __arc_biased_drain(atomic_exchange_explicit(&__arc_biased_queue->head, NULL, memory_order_acquire));
+}
+
+size_t arc_size(void *arc_data) {
+  arc_header_t *header = __get_header(arc_data);
+  return (__arc_flags(header) & __ARC_FLAG_EXT) ? __get_ext(header)->nbytes : 0;
+}
+
+void arc_free(void *arc_data, void(*destructor)(void *)) {
+  arc_free_n(arc_data, 1, destructor);
+}
+
+// the arcs that keep their strongs elsewhere, out of line so that plain
+// frees dont pay for their stack frame...
+static int __arc_release_counted(arc_header_t *header, uint32_t counted, size_t n, void(*destructor)(void *)) {
+  if (counted & __ARC_FLAG_BIASED) {
+    // biased arcs only ever hold the one ref in strong_count...
+    return __arc_biased_release(header, destructor, n) && __arc_drop_strong(header);
+  }
+  if (counted & __ARC_FLAG_SHARDED) {
+    return __arc_sharded_release(header, n) && __arc_drop_strong(header);
+  }
+  return __arc_traced_release(header, n) && __arc_drop_strong(header);
+}
+
+// drop n strongs from whichever count the arc keeps them in, returning true
+// when they were the last and the data needs destroying...
+static inline int __arc_release_strong(void *arc_data, size_t n, void(*destructor)(void *)) {
+  arc_header_t *header = __get_header(arc_data);
+  uint32_t counted = __arc_counted(header);
+  if (__builtin_expect(counted == 0, 1)) {
+    return __arc_drop_strong_n(header, n);
+  }
+  return __arc_release_counted(header, counted, n, destructor);
+}
+
+void arc_free_n(void *arc_data, size_t n, void(*destructor)(void *)) {
+  if (n > 0 && __arc_release_strong(arc_data, n, destructor)) {
+    __arc_destroy(arc_data, destructor);
+  }
+}
+
+void arc_free_deferred(void *arc_data, void(*destructor)(void *)) {
+  if (__arc_release_strong(arc_data, 1, destructor)) {
+    __arc_defer(arc_data, destructor);
+  }
+}
+
+static int __arc_compare_ptrs(const void *a, const void *b) {
+  uintptr_t lhs = (uintptr_t) *(void *const *) a;
+  uintptr_t rhs = (uintptr_t) *(void *const *) b;
+  return (lhs > rhs) - (lhs < rhs);
+}
+
+void arc_free_many(void **arcs, size_t count, void(*destructor)(void *)) {
+  // line up refs to the same arc so each one costs a single decrement...
+  qsort(arcs, count, sizeof(void *), __arc_compare_ptrs);
+  for (size_t i = 0; i < count;) {
+    size_t run = 1;
+    while (i + run < count && arcs[i + run] == arcs[i]) {
+      ++run;
+    }
+    arc_free_n(arcs[i], run, destructor);
+    i += run;
+  }
+}
+
+void *arc_clone(void *arc_data) {
+  arc_header_t *header = __get_header(arc_data);
+  __ARC_STAT(__ARC_STAT_CLONES, 1);
+  uint32_t counted = __arc_counted(header);
+  if (__builtin_expect(counted == 0, 1)) {
+    return __arc_clone(header, arc_data);
+  }
+  if (counted & __ARC_FLAG_BIASED) {
+    return __arc_biased_clone(header, arc_data, 1);
+  }
+  if (counted & __ARC_FLAG_SHARDED) {
+    return __arc_sharded_clone(header, arc_data, 1);
+  }
+  return __arc_traced_clone(header, arc_data, 1);
+}
+
+void *arc_clone_n(void *arc_data, size_t n) {
+  arc_header_t *header = __get_header(arc_data);
+  __ARC_STAT(__ARC_STAT_CLONES, 1);
+  uint32_t counted = __arc_counted(header);
+  if (__builtin_expect(counted == 0, 1)) {
+    return __arc_clone_n(header, arc_data, n);
+  }
+  if (counted & __ARC_FLAG_BIASED) {
+    return __arc_biased_clone(header, arc_data, n);
+  }
+  if (counted & __ARC_FLAG_SHARDED) {
+    return __arc_sharded_clone(header, arc_data, n);
+  }
+  return __arc_traced_clone(header, arc_data, n);
+}
+
+void *arc_downgrade(void *arc_data) {
+  __ARC_STAT(__ARC_STAT_DOWNGRADES, 1);
+  arc_header_t *header = __get_header(arc_data);
+  if (__arc_flags(header) & __ARC_FLAG_TRACED) {
+    errno = EINVAL;
+    return NULL;
+  }
+  return __arc_downgrade(header, arc_data);
+}
+
+void *arc_get_mut(void *arc_data) {
+  arc_header_t *header = __get_header(arc_data);
+  if (__arc_flags(header) & __ARC_FLAG_READONLY) {
+    return NULL;
+  }
+  if ((__arc_flags(header) & __ARC_FLAG_BIASED) && !__arc_biased_unique(header)) {
+    return NULL;
+  }
+  if ((__arc_flags(header) & __ARC_FLAG_SHARDED) && !__arc_sharded_unique(header)) {
+    return NULL;
+  }
+  // (a traced arc in the candidate buffer has its weak out, so it only looks
+  // unique once the collector lets go of it)
+  if ((__arc_flags(header) & __ARC_FLAG_TRACED)
+    && __arc_traced_count(atomic_load_explicit(&__get_traced(header)->state, memory_order_acquire)) != 1
+  ) {
+    return NULL;
+  }
+  return __arc_unique(header) ? arc_data : NULL;
+}
+
+void *arc_make_mut(void *arc_data, size_t nbytes, void(*copy)(void *dst, const void *src), void(*destructor)(void *)) {
+  if (arc_get_mut(arc_data) != NULL) {
+    return arc_data;
+  }
+  arc_header_t *header = __get_header(arc_data);
+  void(*recorded)(void *) = NULL;
+  if (__arc_flags(header) & __ARC_FLAG_EXT) {
+    recorded = __get_ext(header)->destructor;
+    nbytes = nbytes != 0 ? nbytes : __get_ext(header)->nbytes;
+  }
+  if (nbytes == 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  // keep the copy freeable the same way the original was...
+  void *copied;
+  if (__arc_flags(header) & __ARC_FLAG_ARRAY) {
+    arc_array_t *array = __get_array(header);
+    nbytes = array->count * array->elem_size;
+    copied = arc_new_array_with_dtor(array->count, array->elem_size, array->elem_destructor);
+  } else if (__arc_flags(header) & __ARC_FLAG_TRACED) {
+    copied = arc_new_traced(nbytes, __get_traced(header)->trace, recorded);
+  } else {
+    copied = recorded != NULL ? arc_new_with_dtor(nbytes, recorded) : arc_new(nbytes);
+  }
+  if (copied == NULL) {
+    return NULL;
+  }
+  if (copy != NULL) {
+    copy(copied, arc_data);
+  } else {
+    memcpy(copied, arc_data, nbytes);
+  }
+  // everyone else may well have let go since we looked, so this could be
+  // the last of it
+  arc_free(arc_data, destructor);
+  return copied;
+}
+
+void weak_free(void *weak_data) {
+  weak_free_n(weak_data, 1);
+}
+
+void weak_free_n(void *weak_data, size_t n) {
+  if (n == 0) {
+    return;
+  }
+  arc_header_t *header = __get_header(weak_data);
+  if (__arc_drop_weak_n(header, n)) {
+    // we have exclusive access to the previously shared data, so we can 
+    // free its allocation...
+    __arc_release(header);
+  }
+}
+
+void *weak_clone(void *weak_data) {
+  return __arc_weak_clone(__get_header(weak_data), weak_data);
+}
+
+void *weak_clone_n(void *weak_data, size_t n) {
+  return __arc_weak_clone_n(__get_header(weak_data), weak_data, n);
+}
+
+void *weak_upgrade(void *weak_data) {
+  arc_header_t *header = __get_header(weak_data);
+  void *arc_data;
+  uint32_t counted = __arc_counted(header);
+  if (__builtin_expect(counted == 0, 1)) {
+    arc_data = __arc_upgrade(header, weak_data);
+  } else if (counted & __ARC_FLAG_BIASED) {
+    arc_data = __arc_biased_upgrade(header, weak_data);
+  } else if (counted & __ARC_FLAG_SHARDED) {
+    arc_data = __arc_sharded_upgrade(header, weak_data);
+  } else {
+    arc_data = __arc_upgrade(header, weak_data);
+  }
+  __ARC_STAT(__ARC_STAT_UPGRADES, 1);
+  __ARC_STAT(__ARC_STAT_UPGRADE_FAILURES, arc_data == NULL);
+  if (arc_data == NULL) {
+    __ARC_PROBE1(weak, upgrade_fail, weak_data);
+  }
+  return arc_data;
+}
+
+int arc_atomic_init(arc_atomic_t *cell, void *arc_data) {
+  if (__arc_atomic_reserve(arc_data) != 0) {
+    atomic_init(&cell->word, 0);
+    return -1;
+  }
+  atomic_init(&cell->word, __arc_atomic_word(arc_data));
+  return 0;
+}
+
+void *arc_atomic_load(arc_atomic_t *cell) {
+  uint64_t word = atomic_load_explicit(&cell->word, memory_order_relaxed);
+  uint64_t pinned;
+  for (;;) {
+    if (__arc_atomic_ptr(word) == NULL) {
+      return NULL;
+    }
+    // out of pins, someone has to take theirs back before we can...
+    if (__arc_atomic_pins(word) == __ARC_ATOMIC_MAX_PINS) {
+      word = atomic_load_explicit(&cell->word, memory_order_relaxed);
+      continue;
+    }
+    pinned = word + __ARC_ATOMIC_PIN;
+    // acquire pairs with the release in store/swap, so we see the data
+    if (atomic_compare_exchange_weak_explicit(
+      &cell->word,
+      &word, pinned,
+      memory_order_acquire,
+      memory_order_relaxed)
+    ) {
+      break;
+    }
+  }
+  void *arc_data = __arc_atomic_ptr(pinned);
+  // the slot's ref can't go while we're pinned, so this clone is safe... it
+  // can still find the count full, and then the pin goes back all the same
+  void *cloned = arc_clone(arc_data);
+  // and take the pin back, unless it already got turned into a strong
+  word = pinned;
+  while (__arc_atomic_ptr(word) == arc_data && __arc_atomic_pins(word) > 0) {
+    if (atomic_compare_exchange_weak_explicit(
+      &cell->word,
+      &word, word - __ARC_ATOMIC_PIN,
+      memory_order_relaxed,
+      memory_order_relaxed)
+    ) {
+      return cloned;
+    }
+  }
+  // our pin left with the old word, so drop the strong it became... it can't
+  // be the last, we still hold our clone (and a count too full to clone is
+  // nowhere near its last either)
+  arc_free_n(arc_data, 1, NULL);
+  return cloned;
+}
+
+int arc_borrow_begin(void) {
+  arc_borrower_t *self = __arc_borrower_self();
+  if (self == NULL) {
+    return -1;
+  }
+  if (self->depth++ > 0) {
+    return 0;
+  }
+  atomic_fetch_add_explicit(&__arc_borrowing, 1, memory_order_relaxed);
+  atomic_store_explicit(&self->epoch, atomic_load_explicit(&__arc_epoch, memory_order_relaxed), memory_order_relaxed);
+  // nothing we read from here on can be ordered before we showed up
+  atomic_thread_fence(memory_order_seq_cst);
+  return 0;
+}
+
+void arc_borrow_end(void) {
+  arc_borrower_t *self = __arc_borrower;
+  if (--self->depth > 0) {
+    return;
+  }
+  atomic_store_explicit(&self->epoch, 0, memory_order_release);
+  atomic_fetch_sub_explicit(&__arc_borrowing, 1, memory_order_release);
+  if (self->limbo != NULL || atomic_load_explicit(&__arc_orphans, memory_order_relaxed) != NULL) {
+    __arc_borrow_collect(self);
+  }
+}
+
+void *arc_atomic_borrow(arc_atomic_t *cell) {
+  // acquire pairs with the release in store/swap, so we see the data
+  return __arc_atomic_ptr(atomic_load_explicit(&cell->word, memory_order_acquire));
+}
+
+size_t arc_borrow_collect(void) {
+  arc_borrower_t *self = __arc_borrower_self();
+  return self != NULL ? __arc_borrow_collect(self) : 0;
+}
+
+int arc_atomic_store(arc_atomic_t *cell, void *arc_data, void(*destructor)(void *)) {
+  if (__arc_atomic_reserve(arc_data) != 0) {
+    return -1;
+  }
+  uint64_t word = atomic_exchange_explicit(&cell->word, __arc_atomic_word(arc_data), memory_order_acq_rel);
+  void *old = __arc_atomic_unpin(word);
+  if (old != NULL) {
+    arc_free(old, destructor);
+  }
+  return 0;
+}
+
+void *arc_atomic_swap(arc_atomic_t *cell, void *arc_data) {
+  if (__arc_atomic_reserve(arc_data) != 0) {
+    return NULL;
+  }
+  uint64_t word = atomic_exchange_explicit(&cell->word, __arc_atomic_word(arc_data), memory_order_acq_rel);
+  return __arc_atomic_unpin(word);
+}
+
+int arc_atomic_compare_exchange(arc_atomic_t *cell, void *expected, void *desired, void(*destructor)(void *)) {
+  if (__arc_atomic_reserve(desired) != 0) {
+    return -1;
+  }
+  uint64_t word = atomic_load_explicit(&cell->word, memory_order_relaxed);
+  uint64_t next = __arc_atomic_word(desired);
+  // pins coming and going don't count as the slot changing...
+  while (__arc_atomic_ptr(word) == expected) {
+    if (atomic_compare_exchange_weak_explicit(
+      &cell->word,
+      &word, next,
+      memory_order_acq_rel,
+      memory_order_relaxed)
+    ) {
+      if (__arc_atomic_unpin(word) != NULL) {
+        arc_free(expected, destructor);
+      }
+      return 1;
+    }
+  }
+  // never went in, so hand back what we reserved for it
+  __arc_atomic_unpin(next);
+  return 0;
+}
+
+int arc_shm_init(void *base, size_t size) {
+  arc_shm_region_t *region = base;
+  if (((uintptr_t) base & (__ARC_SHM_GRAIN - 1)) != 0 || size < sizeof(arc_shm_region_t)) {
+    errno = EINVAL;
+    return -1;
+  }
+  // other processes see the same words, which only works without locks
+  arc_header_t probe;
+  if (!atomic_is_lock_free(&region->bump) || !atomic_is_lock_free(__ARC_STRONG(&probe))) {
+    errno = ENOTSUP;
+    return -1;
+  }
+  region->magic = __ARC_SHM_MAGIC;
+  region->granules = size / __ARC_SHM_GRAIN;
+  uint64_t start = (sizeof(arc_shm_region_t) + __ARC_SHM_GRAIN - 1) / __ARC_SHM_GRAIN;
+  atomic_init(&region->bump, start);
+  for (size_t i = 0; i < __ARC_SHM_CLASSES; ++i) {
+    atomic_init(&region->free[i], 0);
+  }
+  return 0;
+}
+
+void *arc_shm_new(void *base, size_t nbytes) {
+  if (nbytes == 0) {
+    return NULL;
+  }
+  arc_shm_region_t *region = base;
+  assert(region->magic == __ARC_SHM_MAGIC && "arc_shm_new on an unformatted region");
+  // only ever used for the one alloc, frees go through the block's prefix
+  arc_allocator_t allocator = {__arc_shm_alloc, NULL, region, NULL};
+  void *data = __arc_alloc(&allocator, nbytes, sizeof(uintptr_t), __ARC_FLAG_SHM, sizeof(arc_shm_block_t), 0);
+  if (data == NULL) {
+    errno = ENOMEM;
+  }
+  return data;
+}
+
+uint64_t arc_shm_offset(void *base, void *arc_data) {
+  return (uint64_t)((uint8_t *) arc_data - (uint8_t *) base);
+}
+
+void *arc_shm_at(void *base, uint64_t offset) {
+  return (uint8_t *) base + offset;
+}
+
+arc_bytes_t arc_bytes_from(void *arc_data, size_t len) {
+  arc_bytes_t bytes = {__get_header(arc_data), 0, len};
+  return bytes;
+}
+
+uint8_t *arc_bytes_data(arc_bytes_t bytes) {
+  return (uint8_t *) bytes.header + __ARC_HEADER_SIZE_WITH_PAD + bytes.offset;
+}
+
+arc_bytes_t arc_bytes_slice(arc_bytes_t bytes, size_t begin, size_t end) {
+  arc_bytes_t slice = {NULL, 0, 0};
+  if (begin > end || end > bytes.len) {
+    errno = EINVAL;
+    return slice;
+  }
+  if (arc_clone((uint8_t *) bytes.header + __ARC_HEADER_SIZE_WITH_PAD) == NULL) {
+    return slice;
+  }
+  slice.header = bytes.header;
+  slice.offset = bytes.offset + begin;
+  slice.len = end - begin;
+  return slice;
+}
+
+arc_bytes_t arc_bytes_split_to(arc_bytes_t *bytes, size_t at) {
+  arc_bytes_t front = arc_bytes_slice(*bytes, 0, at);
+  if (front.header != NULL) {
+    bytes->offset += at;
+    bytes->len -= at;
+  }
+  return front;
+}
+
+arc_bytes_t arc_bytes_split_off(arc_bytes_t *bytes, size_t at) {
+  arc_bytes_t back = arc_bytes_slice(*bytes, at, bytes->len);
+  if (back.header != NULL) {
+    bytes->len = at;
+  }
+  return back;
+}
+
+void arc_bytes_free(arc_bytes_t *bytes) {
+  if (bytes->header != NULL) {
+    arc_free((uint8_t *) bytes->header + __ARC_HEADER_SIZE_WITH_PAD, NULL);
+  }
+  bytes->header = NULL;
+  bytes->offset = 0;
+  bytes->len = 0;
+}
+
+static uint64_t __arc_intern_hash(const void *bytes, size_t nbytes) {
+  // fnv-1a, nothing fancy...
+  const uint8_t *p = bytes;
+  uint64_t hash = 14695981039346656037ull;
+  for (size_t i = 0; i < nbytes; ++i) {
+    hash = (hash ^ p[i]) * 1099511628211ull;
+  }
+  return hash;
+}
+
+// double the (locked) stripe's buckets, or leave the chains to grow longer
+// if there's no memory for it
+static void __arc_intern_grow(arc_intern_stripe_t *stripe) {
+  size_t capacity = stripe->capacity * 2;
+  arc_intern_entry_t **buckets = calloc(capacity, sizeof(arc_intern_entry_t *));
+  if (buckets == NULL) {
+    return;
+  }
+  for (size_t i = 0; i < stripe->capacity; ++i) {
+    arc_intern_entry_t *entry = stripe->buckets[i];
+    while (entry != NULL) {
+      arc_intern_entry_t *next = entry->next;
+      entry->next = buckets[entry->hash & (capacity - 1)];
+      buckets[entry->hash & (capacity - 1)] = entry;
+      entry = next;
+    }
+  }
+  free(stripe->buckets);
+  stripe->buckets = buckets;
+  stripe->capacity = capacity;
+}
+
+// find the live arc holding bytes in the (locked) stripe, or NULL and ENOENT,
+// pruning the entry if it turns out to be dead... there's only ever one entry
+// per key, since we never add one while another is still there
+static void *__arc_intern_lookup(arc_intern_stripe_t *stripe, uint64_t hash, const void *bytes, size_t nbytes) {
+  for (arc_intern_entry_t **link = __arc_intern_bucket(stripe, hash); *link != NULL; link = &(*link)->next) {
+    arc_intern_entry_t *entry = *link;
+    // nobody can write to interned data (our weak sees to that), and nothing
+    // destroys it while it's still in here, so compare before upgrading
+    if (entry->hash != hash || entry->nbytes != nbytes || memcmp(entry->weak, bytes, nbytes) != 0) {
+      continue;
+    }
+    void *arc_data = weak_upgrade(entry->weak);
+    if (arc_data == NULL) {
+      // dead, its last free just hasn't got round to forgetting it yet
+      __arc_intern_unlink(stripe, link);
+      errno = ENOENT;
+    }
+    return arc_data;
+  }
+  errno = ENOENT;
+  return NULL;
+}
+
+// make an arc holding bytes and add it to the (locked) stripe
+static void *__arc_intern_insert(arc_intern_t *table, arc_intern_stripe_t *stripe, uint64_t hash, const void *bytes, size_t nbytes) {
+  arc_intern_t *ref = arc_clone(table);
+  if (ref == NULL) {
+    return NULL;
+  }
+  arc_intern_entry_t *entry = malloc(sizeof(arc_intern_entry_t));
+  void *data = entry == NULL ? NULL : __arc_alloc(
+    __arc_allocator, nbytes, sizeof(uintptr_t), __ARC_FLAG_EXT | __ARC_FLAG_INTERNED,
+    sizeof(arc_interned_t) + sizeof(arc_ext_t), 0
+  );
+  if (data == NULL) {
+    free(entry);
+    // the caller's ref is still out there, so this is never the last
+    arc_free(ref, NULL);
+    errno = ENOMEM;
+    return NULL;
+  }
+  arc_header_t *header = __get_header(data);
+  __arc_ext_init(header, __arc_allocator, nbytes, NULL);
+  arc_interned_t *interned = __get_interned(header);
+  interned->table = ref;
+  interned->hash = hash;
+  memcpy(data, bytes, nbytes);
+  if (stripe->count >= stripe->capacity) {
+    __arc_intern_grow(stripe);
+  }
+  arc_intern_entry_t **bucket = __arc_intern_bucket(stripe, hash);
+  entry->next = *bucket;
+  entry->hash = hash;
+  entry->nbytes = nbytes;
+  // a fresh arc has nowhere near enough weaks to overflow
+  entry->weak = arc_downgrade(data);
+  *bucket = entry;
+  ++stripe->count;
+  return data;
+}
+
+// every interned arc held a ref to the table, so by now they've all left it
+// and only the stripes themselves remain
+static void __arc_intern_destroy(void *arc_data) {
+  arc_intern_t *table = arc_data;
+  for (size_t i = 0; i < ARC_INTERN_STRIPES; ++i) {
+    free(table->stripes[i].buckets);
+    pthread_mutex_destroy(&table->stripes[i].lock);
+  }
+}
+
+arc_intern_t *arc_intern_new(void) {
+  arc_intern_t *table = arc_new_sharded(sizeof(arc_intern_t));
+  if (table == NULL) {
+    return NULL;
+  }
+  int failed = 0;
+  for (size_t i = 0; i < ARC_INTERN_STRIPES; ++i) {
+    arc_intern_stripe_t *stripe = &table->stripes[i];
+    pthread_mutex_init(&stripe->lock, NULL);
+    stripe->buckets = calloc(__ARC_INTERN_BUCKETS, sizeof(arc_intern_entry_t *));
+    stripe->capacity = __ARC_INTERN_BUCKETS;
+    stripe->count = 0;
+    failed |= stripe->buckets == NULL;
+  }
+  __get_ext(__get_header(table))->destructor = __arc_intern_destroy;
+  if (failed) {
+    arc_free(table, NULL);
+    errno = ENOMEM;
+    return NULL;
+  }
+  return table;
+}
+
+void *arc_intern(arc_intern_t *table, const void *bytes, size_t nbytes) {
+  if (nbytes == 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  uint64_t hash = __arc_intern_hash(bytes, nbytes);
+  arc_intern_stripe_t *stripe = __arc_intern_stripe(table, hash);
+  pthread_mutex_lock(&stripe->lock);
+  void *arc_data = __arc_intern_lookup(stripe, hash, bytes, nbytes);
+  if (arc_data == NULL) {
+    arc_data = __arc_intern_insert(table, stripe, hash, bytes, nbytes);
+  }
+  pthread_mutex_unlock(&stripe->lock);
+  return arc_data;
+}
+
+void *arc_intern_find(arc_intern_t *table, const void *bytes, size_t nbytes) {
+  uint64_t hash = __arc_intern_hash(bytes, nbytes);
+  arc_intern_stripe_t *stripe = __arc_intern_stripe(table, hash);
+  pthread_mutex_lock(&stripe->lock);
+  void *arc_data = __arc_intern_lookup(stripe, hash, bytes, nbytes);
+  pthread_mutex_unlock(&stripe->lock);
+  return arc_data;
+}
+
+size_t arc_intern_count(arc_intern_t *table) {
+  size_t count = 0;
+  for (size_t i = 0; i < ARC_INTERN_STRIPES; ++i) {
+    pthread_mutex_lock(&table->stripes[i].lock);
+    count += table->stripes[i].count;
+    pthread_mutex_unlock(&table->stripes[i].lock);
+  }
+  return count;
+}
+
+size_t arc_intern_prune(arc_intern_t *table) {
+  size_t pruned = 0;
+  for (size_t i = 0; i < ARC_INTERN_STRIPES; ++i) {
+    arc_intern_stripe_t *stripe = &table->stripes[i];
+    pthread_mutex_lock(&stripe->lock);
+    for (size_t j = 0; j < stripe->capacity; ++j) {
+      arc_intern_entry_t **link = &stripe->buckets[j];
+      while (*link != NULL) {
+        // a strong count of zero stays zero, nothing upgrades past it
+        if (__arc_strong_count(__get_header((*link)->weak)) == 0) {
+          __arc_intern_unlink(stripe, link);
+          ++pruned;
+        } else {
+          link = &(*link)->next;
+        }
+      }
+    }
+    pthread_mutex_unlock(&stripe->lock);
+  }
+  return pruned;
+}
+
+void arc_intern_free(arc_intern_t *table) {
+  arc_free(table, NULL);
+}
+
+// channels are Vyukov's bounded mpmc ring, where every cell carries a
+// sequence that says whose turn it is (pos for the sender of lap pos, pos + 1
+// for its receiver)... batches claim a run of cells whose turn it is with a
+// single CAS, since nobody else can touch a cell until the position passes it
+static const int __ARC_FUTEX_WAIT = 0;
+static const int __ARC_FUTEX_WAKE = 1;
+static const int __ARC_FUTEX_PRIVATE = 128;
+
+typedef struct arc_channel_cell {
+  atomic_size_t sequence;
+  void *arc_data;
+} arc_channel_cell_t;
+
+typedef struct arc_channel_side {
+  atomic_size_t pos;
+  // bumped by the other side whenever it frees something up for a thread
+  // parked here, which is the futex word we sleep on
+  atomic_uint event;
+  atomic_uint waiters;
+  char pad[ARC_CACHE_LINE_SIZE];
+} arc_channel_side_t;
+
+struct arc_channel {
+  arc_channel_side_t senders;
+  arc_channel_side_t receivers;
+  size_t mask;
+  unsigned flags;
+  atomic_int closed;
+  arc_channel_cell_t cells[];
+};
+
+static void __arc_futex_wait(atomic_uint *word, unsigned seen) {
+#ifdef SYS_futex
+  syscall(SYS_futex, word, __ARC_FUTEX_WAIT | __ARC_FUTEX_PRIVATE, seen, NULL, NULL, 0);
+#else
+  (void) word;
+  (void) seen;
+  sched_yield();
+#endif // SYS_futex
+}
+
+static void __arc_futex_wake(atomic_uint *word) {
+#ifdef SYS_futex
+  syscall(SYS_futex, word, __ARC_FUTEX_WAKE | __ARC_FUTEX_PRIVATE, INT_MAX, NULL, NULL, 0);
+#else
+  (void) word;
+#endif // SYS_futex
+}
+
+// fill as many of count cells from the send position as are free...
+static size_t __arc_channel_put(arc_channel_t *channel, void **arcs, size_t count) {
+  size_t pos = atomic_load_explicit(&channel->senders.pos, memory_order_relaxed);
+  for (;;) {
+    size_t ready = 0;
+    while (ready < count) {
+      arc_channel_cell_t *cell = &channel->cells[(pos + ready) & channel->mask];
+      if (atomic_load_explicit(&cell->sequence, memory_order_acquire) != pos + ready) {
+        break;
+      }
+      ++ready;
+    }
+    if (ready == 0) {
+      // full, unless another sender moved the position on under us
+      size_t now = atomic_load_explicit(&channel->senders.pos, memory_order_relaxed);
+      if (now == pos) {
+        return 0;
+      }
+      pos = now;
+      continue;
+    }
+    if (atomic_compare_exchange_weak_explicit(&channel->senders.pos, &pos, pos + ready, memory_order_relaxed, memory_order_relaxed)) {
+      for (size_t i = 0; i < ready; ++i) {
+        arc_channel_cell_t *cell = &channel->cells[(pos + i) & channel->mask];
+        cell->arc_data = arcs[i];
+        atomic_store_explicit(&cell->sequence, pos + i + 1, memory_order_release);
+      }
+      return ready;
+    }
+    ARC_ON_RETRY("arc_channel_send");
+  }
+}
+
+// ...and empty as many of max cells from the receive position as are full,
+// handing each one back to the sender a lap ahead
+static size_t __arc_channel_take(arc_channel_t *channel, void **arcs, size_t max) {
+  size_t pos = atomic_load_explicit(&channel->receivers.pos, memory_order_relaxed);
+  for (;;) {
+    size_t ready = 0;
+    while (ready < max) {
+      arc_channel_cell_t *cell = &channel->cells[(pos + ready) & channel->mask];
+      if (atomic_load_explicit(&cell->sequence, memory_order_acquire) != pos + ready + 1) {
+        break;
+      }
+      ++ready;
+    }
+    if (ready == 0) {
+      size_t now = atomic_load_explicit(&channel->receivers.pos, memory_order_relaxed);
+      if (now == pos) {
+        return 0;
+      }
+      pos = now;
+      continue;
+    }
+    if (atomic_compare_exchange_weak_explicit(&channel->receivers.pos, &pos, pos + ready, memory_order_relaxed, memory_order_relaxed)) {
+      for (size_t i = 0; i < ready; ++i) {
+        arc_channel_cell_t *cell = &channel->cells[(pos + i) & channel->mask];
+        arcs[i] = cell->arc_data;
+        atomic_store_explicit(&cell->sequence, pos + i + channel->mask + 1, memory_order_release);
+      }
+      return ready;
+    }
+    ARC_ON_RETRY("arc_channel_recv");
+  }
+}
+
+// tell anyone parked on side that things moved, if the channel blocks at all
+static void __arc_channel_notify(arc_channel_t *channel, arc_channel_side_t *side) {
+  if (!(channel->flags & ARC_CHANNEL_BLOCKING)) {
+    return;
+  }
+  // pairs with the fence in __arc_channel_move, so either the waiter sees
+  // our cells or we see the waiter
+  atomic_thread_fence(memory_order_seq_cst);
+  if (atomic_load_explicit(&side->waiters, memory_order_relaxed) > 0) {
+    atomic_fetch_add_explicit(&side->event, 1, memory_order_relaxed);
+    __arc_futex_wake(&side->event);
+  }
+}
+
+// run attempt until it moves something, parking on side between goes when
+// the channel blocks... the attempt after announcing ourselves (and before
+// sleeping) is what keeps a wakeup from slipping past us unseen
+static size_t __arc_channel_move(
+  arc_channel_t *channel, arc_channel_side_t *side, arc_channel_side_t *other,
+  size_t(*attempt)(arc_channel_t *, void **, size_t), void **arcs, size_t count
+) {
+  if (count == 0) {
+    return 0;
+  }
+  size_t moved = attempt(channel, arcs, count);
+  while (moved == 0 && (channel->flags & ARC_CHANNEL_BLOCKING)) {
+    if (atomic_load_explicit(&channel->closed, memory_order_acquire)) {
+      break;
+    }
+    unsigned seen = atomic_load_explicit(&side->event, memory_order_relaxed);
+    atomic_fetch_add_explicit(&side->waiters, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_seq_cst);
+    moved = attempt(channel, arcs, count);
+    if (moved == 0 && !atomic_load_explicit(&channel->closed, memory_order_acquire)) {
+      __arc_futex_wait(&side->event, seen);
+    }
+    atomic_fetch_sub_explicit(&side->waiters, 1, memory_order_relaxed);
+  }
+  if (moved > 0) {
+    __arc_channel_notify(channel, other);
+  }
+  return moved;
+}
+
+arc_channel_t *arc_channel_new(size_t capacity, unsigned flags) {
+  if (capacity == 0 || (flags & ~(unsigned) ARC_CHANNEL_BLOCKING) != 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  // a single cell can't tell a full ring from an empty one
+  size_t cells = 2;
+  while (cells < capacity) {
+    if (cells > (SIZE_MAX - sizeof(arc_channel_t)) / sizeof(arc_channel_cell_t) / 2) {
+      errno = ENOMEM;
+      return NULL;
+    }
+    cells *= 2;
+  }
+  arc_channel_t *channel = malloc(sizeof(arc_channel_t) + cells * sizeof(arc_channel_cell_t));
+  if (channel == NULL) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  arc_channel_side_t *sides[] = {&channel->senders, &channel->receivers};
+  for (size_t i = 0; i < 2; ++i) {
+    atomic_init(&sides[i]->pos, 0);
+    atomic_init(&sides[i]->event, 0);
+    atomic_init(&sides[i]->waiters, 0);
+  }
+  channel->mask = cells - 1;
+  channel->flags = flags;
+  atomic_init(&channel->closed, 0);
+  for (size_t i = 0; i < cells; ++i) {
+    atomic_init(&channel->cells[i].sequence, i);
+    channel->cells[i].arc_data = NULL;
+  }
+  return channel;
+}
+
+int arc_channel_send(arc_channel_t *channel, void *arc_data) {
+  return arc_channel_send_n(channel, &arc_data, 1) == 1 ? 0 : -1;
+}
+
+size_t arc_channel_send_n(arc_channel_t *channel, void **arcs, size_t count) {
+  if (atomic_load_explicit(&channel->closed, memory_order_acquire)) {
+    errno = EPIPE;
+    return 0;
+  }
+  size_t sent = __arc_channel_move(channel, &channel->senders, &channel->receivers, __arc_channel_put, arcs, count);
+  if (sent == 0 && count > 0) {
+    errno = atomic_load_explicit(&channel->closed, memory_order_acquire) ? EPIPE : EAGAIN;
+  }
+  return sent;
+}
+
+void *arc_channel_recv(arc_channel_t *channel) {
+  void *arc_data = NULL;
+  arc_channel_recv_n(channel, &arc_data, 1);
+  return arc_data;
+}
+
+size_t arc_channel_recv_n(arc_channel_t *channel, void **arcs, size_t max) {
+  size_t received = __arc_channel_move(channel, &channel->receivers, &channel->senders, __arc_channel_take, arcs, max);
+  if (received == 0 && max > 0) {
+    // a send that beat the close may still have been on its way in
+    int closed = atomic_load_explicit(&channel->closed, memory_order_acquire);
+    received = closed ? __arc_channel_take(channel, arcs, max) : 0;
+    if (received == 0) {
+      errno = closed ? EPIPE : EAGAIN;
+    }
+  }
+  return received;
+}
+
+void arc_channel_close(arc_channel_t *channel) {
+  atomic_store_explicit(&channel->closed, 1, memory_order_release);
+  arc_channel_side_t *sides[] = {&channel->senders, &channel->receivers};
+  for (size_t i = 0; i < 2; ++i) {
+    atomic_fetch_add_explicit(&sides[i]->event, 1, memory_order_release);
+    __arc_futex_wake(&sides[i]->event);
+  }
+}
+
+void arc_channel_free(arc_channel_t *channel, void(*destructor)(void *)) {
+  void *arcs[64];
+  size_t received;
+  while ((received = __arc_channel_take(channel, arcs, 64)) > 0) {
+    arc_free_many(arcs, received, destructor);
+  }
+  free(channel);
+}
+
+void arc_intrusive_init(arc_header_t *header) {
+  // there's no block or prefix behind an intrusive header, nothing to free
+  // (and no meta saying otherwise)
+  __arc_init_counts(header);
+}
+
+arc_header_t *arc_intrusive_clone(arc_header_t *header) {
+  return __arc_clone(header, header);
+}
+
+void arc_intrusive_release(arc_header_t *header, void(*release)(arc_header_t *)) {
+  // same ordering as arc_free, the acquire lives in the drop
+  if (__arc_drop_strong(header) && release != NULL) {
+    release(header);
+  }
+}
+
+// stands in for the destructor on the way out of arcs whose data lives on
+// somewhere else (unwrapped into the caller, or moved to a bigger block)
+static void __arc_moved(void *arc_data) {
+  (void) arc_data;
+}
+
+int arc_try_unwrap(void *arc_data, void *out, size_t nbytes) {
+  if (arc_get_mut(arc_data) == NULL) {
+    errno = EBUSY;
+    return -1;
+  }
+  arc_header_t *header = __get_header(arc_data);
+  if (nbytes == 0 && (__arc_flags(header) & __ARC_FLAG_EXT)) {
+    nbytes = __get_ext(header)->nbytes;
+  }
+  if (nbytes == 0) {
+    errno = EINVAL;
+    return -1;
+  }
+  memcpy(out, arc_data, nbytes);
+  // the rest is an ordinary last drop (borrowers still get their grace
+  // period, tables their forget...) that just skips the destructor
+  if (__arc_release_strong(arc_data, 1, __arc_moved)) {
+    __arc_destroy(arc_data, __arc_moved);
+  }
+  return 0;
+}
+
+// same as __arc_resize, except a guard may still be reading the old block,
+// so the data gets copied into a fresh one and the old one goes the way of
+// any other last drop... which takes knowing how big the old one was
+static arc_header_t *__arc_resize_guarded(arc_header_t *header, size_t nbytes) {
+  size_t offset = __arc_offset(header);
+  uint8_t *block = (uint8_t *) header - offset;
+  size_t total = offset + __ARC_HEADER_SIZE_WITH_PAD + nbytes;
+  uint32_t flags = __arc_flags(header);
+  const arc_allocator_t *allocator = __arc_allocator;
+  size_t old;
+  if (flags & __ARC_FLAG_EXT) {
+    allocator = __get_ext(header)->allocator;
+    old = offset + __ARC_HEADER_SIZE_WITH_PAD + __get_ext(header)->nbytes;
+#ifdef ARC_POOL
+  } else if (flags & __ARC_FLAG_POOL) {
+    old = __arc_pool_slab_of(block)->block_size;
+#endif // ARC_POOL
+  } else {
+    errno = EBUSY;
+    return NULL;
+  }
+  size_t copied = old < total ? old : total;
+  size_t growth = 0;
+#ifdef ARC_POOL
+  growth = (flags & __ARC_FLAG_POOL) ? __arc_unpool_growth(header) : 0;
+#endif // ARC_POOL
+  uint8_t *fresh = allocator->alloc(allocator->ctx, total + growth);
+  if (fresh == NULL) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  arc_header_t *moved = NULL;
+#ifdef ARC_POOL
+  if (flags & __ARC_FLAG_POOL) {
+    moved = __arc_unpool(header, fresh, copied);
+  }
+#endif // ARC_POOL
+  if (moved == NULL) {
+    memcpy(fresh, block, copied);
+    moved = (arc_header_t *)(fresh + offset);
+  }
+#ifdef ARC_STATS
+  // the old block gets counted out as it goes, so count it in here...
+  __ARC_STAT(__ARC_STAT_ALLOCATIONS, 1);
+  __ARC_STAT(__ARC_STAT_BYTES_IN, *(size_t *) block);
+#endif // ARC_STATS
+  // and the sample follows the data to its new home
+  if (flags & __ARC_FLAG_SAMPLED) {
+    __get_meta(header)->flags &= ~__ARC_FLAG_SAMPLED;
+  }
+  void *arc_data = (uint8_t *) header + __ARC_HEADER_SIZE_WITH_PAD;
+  if (__arc_release_strong(arc_data, 1, __arc_moved)) {
+    __arc_destroy(arc_data, __arc_moved);
+  }
+  return moved;
+}
+
+void *arc_realloc(void *arc_data, size_t nbytes) {
+  if (nbytes == 0) {
+    errno = EINVAL;
+    return NULL;
+  }
+  if (arc_get_mut(arc_data) == NULL) {
+    errno = EBUSY;
+    return NULL;
+  }
+  arc_header_t *header = __get_header(arc_data);
+  // moving the block would lose the padding that aligns the data, and
+  // regions don't do resizing...
+  if (__arc_flags(header) & (__ARC_FLAG_ALIGNED | __ARC_FLAG_SHM)) {
+    errno = EINVAL;
+    return NULL;
+  }
+  // the prefix and header come along for the ride, same distance from the
+  // start of the block as before (give or take a meta)
+  if (nbytes > SIZE_MAX - __arc_offset(header) - __ARC_HEADER_SIZE_WITH_PAD - sizeof(arc_meta_t)) {
+    errno = ENOMEM;
+    return NULL;
+  }
+  header = __arc_borrow_guarded() ? __arc_resize_guarded(header, nbytes) : __arc_resize(header, nbytes);
+  if (header == NULL) {
+    return NULL;
+  }
+  uint8_t *moved = (uint8_t *) header - __arc_offset(header);
+  size_t lead = __arc_offset(header) + __ARC_HEADER_SIZE_WITH_PAD;
+#ifdef ARC_STATS
+  __ARC_STAT(__ARC_STAT_BYTES_OUT, *(size_t *) moved);
+  __ARC_STAT(__ARC_STAT_BYTES_IN, nbytes);
+  *(size_t *) moved = nbytes;
+#endif // ARC_STATS
+#ifdef ARC_SAMPLING
+  arc_sample_slot_t *slot = (__arc_flags(header) & __ARC_FLAG_SAMPLED) ? *__arc_sample_of(header) : NULL;
+  if (slot != NULL) {
+    atomic_store_explicit(&slot->arc_data, moved + lead, memory_order_relaxed);
+    atomic_store_explicit(&slot->nbytes, nbytes, memory_order_relaxed);
+  }
+#endif // ARC_SAMPLING
+  if (__arc_flags(header) & __ARC_FLAG_EXT) {
+    __get_ext(header)->nbytes = nbytes;
+  }
+  if (__arc_flags(header) & __ARC_FLAG_ARRAY) {
+    // a partial element on the end isn't one we can destroy
+    __get_array(header)->count = nbytes / __get_array(header)->elem_size;
+  }
+  return moved + lead;
+}
+
+void *arc_make_immortal(void *arc_data) {
+  arc_header_t *header = __get_header(arc_data);
+  if (__arc_flags(header) & (__ARC_FLAG_BIASED | __ARC_FLAG_SHARDED | __ARC_FLAG_TRACED)) {
+    errno = EINVAL;
+    return NULL;
+  }
+  // the caller's strong keeps both counts off zero until they're stuck, and
+  // anything racing us either sees them stuck or lands on the old counts,
+  // which we then overwrite anyway
+  __arc_word_t word = atomic_load_explicit(__ARC_STRONG(header), memory_order_relaxed);
+  while (!atomic_compare_exchange_weak_explicit(
+    __ARC_STRONG(header),
+    &word, __ARC_STICK(word, __ARC_STRONG_SHIFT),
+    memory_order_relaxed,
+    memory_order_relaxed)
+  );
+  word = atomic_load_explicit(__ARC_WEAK(header), memory_order_relaxed);
+  while (!atomic_compare_exchange_weak_explicit(
+    __ARC_WEAK(header),
+    &word, __ARC_STICK(word, __ARC_WEAK_SHIFT),
+    memory_order_relaxed,
+    memory_order_relaxed)
+  );
+  return arc_data;
+}
+
+int arc_is_immortal(void *arc_data) {
+  return __ARC_STUCK(__ARC_OPS, __ARC_STRONG(__get_header(arc_data)), __ARC_STRONG_SHIFT);
+}
+
+size_t arc_collect_cycles(size_t budget) {
+  pthread_mutex_lock(&__arc_collector.lock);
+  // acquire pairs with the release push, so the candidates are good to read
+  arc_traced_t *roots = atomic_exchange_explicit(&__arc_collector.candidates, NULL, memory_order_acquire);
+  if (budget > 0) {
+    // over budget, put the rest back for next time...
+    arc_traced_t *rest = roots;
+    roots = __arc_traced_take(&rest, budget);
+    __arc_traced_requeue(rest);
+  }
+  size_t collected = 0;
+  while (roots != NULL) {
+    arc_traced_t *batch = __arc_traced_take(&roots, ARC_COLLECT_BATCH);
+    // the guard keeps whatever we walk over from being destroyed mid walk,
+    // and only lasts the batch, so we never hold up reclamation for long
+    if (arc_borrow_begin() != 0) {
+      __arc_traced_requeue(batch);
+      __arc_traced_requeue(roots);
+      break;
+    }
+    for (int tries = 0; batch != NULL; ++tries) {
+      intptr_t destroyed = tries < ARC_COLLECT_RETRIES ? __arc_collect(batch) : -1;
+      if (destroyed < 0) {
+        // still buffered, weaks and all
+        __arc_traced_requeue(batch);
+        break;
+      }
+      collected += (size_t) destroyed;
+      batch = __arc_traced_settle(batch);
+    }
+    arc_borrow_end();
+  }
+  pthread_mutex_unlock(&__arc_collector.lock);
+  return collected;
+}
+
+int arc_collector_start(unsigned interval_us, size_t budget) {
+  if (atomic_load_explicit(&__arc_collector.running, memory_order_relaxed)) {
+    errno = EALREADY;
+    return -1;
+  }
+  __arc_collector.interval_us = interval_us != 0 ? interval_us : 10000;
+  __arc_collector.budget = budget;
+  atomic_store_explicit(&__arc_collector.running, 1, memory_order_release);
+  int error = pthread_create(&__arc_collector.thread, NULL, __arc_collector_main, NULL);
+  if (error != 0) {
+    atomic_store_explicit(&__arc_collector.running, 0, memory_order_relaxed);
+    errno = error;
+    return -1;
+  }
+  return 0;
+}
+
+void arc_collector_stop(void) {
+  if (atomic_exchange_explicit(&__arc_collector.running, 0, memory_order_acq_rel)) {
+    pthread_join(__arc_collector.thread, NULL);
+  }
+}
+
+int arc_reclaimer_start(const arc_reclaimer_opts_t *opts) {
+  static const arc_reclaimer_opts_t inline_opts = {ARC_RECLAIM_INLINE, 0, 0};
+  if (atomic_load_explicit(&__arc_reclaimer.running, memory_order_relaxed)) {
+    errno = EALREADY;
+    return -1;
+  }
+  __arc_reclaimer.opts = opts != NULL ? *opts : inline_opts;
+  if (__arc_reclaimer.opts.interval_us == 0) {
+    __arc_reclaimer.opts.interval_us = 1000;
+  }
+  if (__arc_reclaimer.opts.mode != ARC_RECLAIM_THREAD) {
+    return 0;
+  }
+  atomic_store_explicit(&__arc_reclaimer.running, 1, memory_order_release);
+  int error = pthread_create(&__arc_reclaimer.thread, NULL, __arc_reclaimer_main, NULL);
+  if (error != 0) {
+    atomic_store_explicit(&__arc_reclaimer.running, 0, memory_order_relaxed);
+    errno = error;
+    return -1;
+  }
+  return 0;
+}
+
+size_t arc_reclaimer_drain(void) {
+  // acquire pairs with the release push, so the nodes are good to read
+  arc_deferred_t *head = atomic_exchange_explicit(&__arc_reclaimer.head, NULL, memory_order_acquire);
+  // the stack hands things back newest first, flip it so we destroy in the
+  // order things died...
+  arc_deferred_t *ordered = NULL;
+  while (head != NULL) {
+    arc_deferred_t *next = head->next;
+    head->next = ordered;
+    ordered = head;
+    head = next;
+  }
+  size_t ran = 0;
+  size_t batch = __arc_reclaimer.opts.batch;
+  while (ordered != NULL && (batch == 0 || ran < batch)) {
+    arc_deferred_t *next = ordered->next;
+    __arc_destroy(ordered->arc_data, ordered->destructor);
+    free(ordered);
+    ordered = next;
+    ++ran;
+  }
+  // over budget, put the rest back for next time...
+  if (ordered != NULL) {
+    arc_deferred_t *last = ordered;
+    while (last->next != NULL) {
+      last = last->next;
+    }
+    __arc_defer_push(ordered, last);
+  }
+  return ran;
+}
+
+void arc_reclaimer_stop(void) {
+  if (atomic_exchange_explicit(&__arc_reclaimer.running, 0, memory_order_acq_rel)) {
+    pthread_join(__arc_reclaimer.thread, NULL);
+  }
+  // and whatever is left goes now, batch or no batch...
+  __arc_reclaimer.opts.batch = 0;
+  while (arc_reclaimer_drain() > 0);
+}
+
+static rc_header_t *__get_rc_header(void *data) {
+  return (rc_header_t *)((uint8_t *) data - __ARC_HEADER_SIZE_WITH_PAD);
+}
+
+// debug builds stamp every rc with the thread that made it, and complain
+// loudly the moment anyone else lays a finger on it...
+#ifndef NDEBUG
+typedef struct rc_debug {
+  size_t owner;
+} rc_debug_t;
+
+static const size_t __RC_LEAD = sizeof(rc_debug_t) + sizeof(arc_ext_t);
+static const uint32_t __RC_FLAGS = __ARC_FLAG_EXT | __ARC_FLAG_OWNED;
+
+static rc_header_t *__rc_check(rc_header_t *header) {
+  rc_debug_t *debug = (rc_debug_t *) __get_ext((arc_header_t *) header) - 1;
+  assert(debug->owner == __arc_self() && "rc used from a thread other than its own");
+  return header;
+}
+#else
+static const size_t __RC_LEAD = 0;
+static const uint32_t __RC_FLAGS = 0;
+
+static rc_header_t *__rc_check(rc_header_t *header) {
+  return header;
+}
+#endif // NDEBUG
+
+int arc_stats_snapshot(arc_stats_t *stats) {
+#ifdef ARC_STATS
+  uint64_t counts[__ARC_STAT_COUNTERS];
+  pthread_mutex_lock(&__arc_stats_lock);
+  for (size_t i = 0; i < __ARC_STAT_COUNTERS; ++i) {
+    counts[i] = atomic_load_explicit(&__arc_stats_spill.counts[i], memory_order_relaxed);
+    for (arc_stats_slot_t *slot = __arc_stats_slots; slot != NULL; slot = slot->next) {
+      counts[i] += atomic_load_explicit(&slot->counts[i], memory_order_relaxed);
+    }
+  }
+  pthread_mutex_unlock(&__arc_stats_lock);
+  stats->allocations = counts[__ARC_STAT_ALLOCATIONS];
+  stats->frees = counts[__ARC_STAT_FREES];
+  // either side can run ahead of the other mid-snapshot, so dont wrap
+  uint64_t in = counts[__ARC_STAT_BYTES_IN];
+  uint64_t out = counts[__ARC_STAT_BYTES_OUT];
+  stats->live_bytes = in > out ? in - out : 0;
+  stats->rc_allocations = counts[__ARC_STAT_RC_ALLOCATIONS];
+  stats->rc_frees = counts[__ARC_STAT_RC_FREES];
+  in = counts[__ARC_STAT_RC_BYTES_IN];
+  out = counts[__ARC_STAT_RC_BYTES_OUT];
+  stats->rc_live_bytes = in > out ? in - out : 0;
+  stats->clones = counts[__ARC_STAT_CLONES];
+  stats->downgrades = counts[__ARC_STAT_DOWNGRADES];
+  stats->upgrades = counts[__ARC_STAT_UPGRADES];
+  stats->upgrade_failures = counts[__ARC_STAT_UPGRADE_FAILURES];
+  stats->clone_retries = counts[__ARC_STAT_CLONE_RETRIES];
+  stats->weak_clone_retries = counts[__ARC_STAT_WEAK_CLONE_RETRIES];
+  stats->downgrade_retries = counts[__ARC_STAT_DOWNGRADE_RETRIES];
+  stats->upgrade_retries = counts[__ARC_STAT_UPGRADE_RETRIES];
+  return 0;
+#else
+  memset(stats, 0, sizeof(arc_stats_t));
+  errno = ENOTSUP;
+  return -1;
+#endif // ARC_STATS
+}
+
+int arc_sample_every(size_t every) {
+#ifdef ARC_SAMPLING
+  atomic_store_explicit(&__arc_sample_rate, every, memory_order_relaxed);
+  return 0;
+#else
+  (void) every;
+  errno = ENOTSUP;
+  return -1;
+#endif // ARC_SAMPLING
+}
+
+size_t arc_sample_dump(arc_sample_t *samples, size_t max) {
+  size_t count = 0;
+#ifdef ARC_SAMPLING
+  for (size_t i = 0; i < ARC_SAMPLE_SLOTS && count < max; ++i) {
+    arc_sample_slot_t *slot = &__arc_samples[i];
+    uint64_t seq = atomic_load_explicit(&slot->seq, memory_order_acquire);
+    if (seq == 0 || (seq & 1)) {
+      continue;
+    }
+    arc_sample_t *sample = &samples[count];
+    sample->arc_data = atomic_load_explicit(&slot->arc_data, memory_order_relaxed);
+    sample->nbytes = atomic_load_explicit(&slot->nbytes, memory_order_relaxed);
+    sample->depth = atomic_load_explicit(&slot->depth, memory_order_relaxed);
+    for (size_t j = 0; j < sample->depth; ++j) {
+      sample->stack[j] = atomic_load_explicit(&slot->stack[j], memory_order_relaxed);
+    }
+    uint64_t born = atomic_load_explicit(&slot->born_ns, memory_order_relaxed);
+    uint64_t died = atomic_load_explicit(&slot->died_ns, memory_order_relaxed);
+    // taken over while we were reading, so whatever we got is a mix of two
+    atomic_thread_fence(memory_order_acquire);
+    if (atomic_load_explicit(&slot->seq, memory_order_relaxed) != seq) {
+      continue;
+    }
+    sample->live = died == 0;
+    sample->lifetime_ns = (died != 0 ? died : __arc_now_ns()) - born;
+    ++count;
+  }
+#else
+  (void) samples;
+  (void) max;
+#endif // ARC_SAMPLING
+  return count;
+}
+
+void *rc_new(size_t nbytes) {
+  if (nbytes == 0) {
+    return NULL;
+  }
+  void *data = __arc_alloc_as(1, __arc_allocator, nbytes, sizeof(uintptr_t), __RC_FLAGS, __RC_LEAD, 0);
+  if (data == NULL) {
+    return NULL;
+  }
+  // (same layout, so the counts and meta __arc_alloc set up are ours too)
+#ifndef NDEBUG
+  rc_header_t *header = __get_rc_header(data);
+  __arc_ext_init((arc_header_t *) header, __arc_allocator, nbytes, NULL);
+  ((rc_debug_t *) __get_ext((arc_header_t *) header) - 1)->owner = __arc_self();
+#endif // NDEBUG
+  return data;
+}
+
+void rc_free(void *rc_data, void(*destructor)(void *)) {
+  rc_free_n(rc_data, 1, destructor);
+}
+
+void rc_free_n(void *rc_data, size_t n, void(*destructor)(void *)) {
+  if (n == 0) {
+    return;
+  }
+  if (__rc_drop_strong_n(__rc_check(__get_rc_header(rc_data)), n)) {
+    if (destructor != NULL) {
+      destructor(rc_data);
+    }
+    weak_rc_free(rc_data);
+  }
+}
+
+void *rc_clone(void *rc_data) {
+  return __rc_clone(__rc_check(__get_rc_header(rc_data)), rc_data);
+}
+
+void *rc_clone_n(void *rc_data, size_t n) {
+  return __rc_clone_n(__rc_check(__get_rc_header(rc_data)), rc_data, n);
+}
+
+void *rc_downgrade(void *rc_data) {
+  return __rc_downgrade(__rc_check(__get_rc_header(rc_data)), rc_data);
+}
+
+void *rc_get_mut(void *rc_data) {
+  return __rc_unique(__rc_check(__get_rc_header(rc_data))) ? rc_data : NULL;
+}
+
+void weak_rc_free(void *weak_data) {
+  weak_rc_free_n(weak_data, 1);
+}
+
+void weak_rc_free_n(void *weak_data, size_t n) {
+  if (n == 0) {
+    return;
+  }
+  rc_header_t *header = __rc_check(__get_rc_header(weak_data));
+  if (__rc_drop_weak_n(header, n)) {
+    __arc_release_as(1, (arc_header_t *) header);
+  }
+}
+
+void *weak_rc_clone(void *weak_data) {
+  return __rc_weak_clone(__rc_check(__get_rc_header(weak_data)), weak_data);
+}
+
+void *weak_rc_clone_n(void *weak_data, size_t n) {
+  return __rc_weak_clone_n(__rc_check(__get_rc_header(weak_data)), weak_data, n);
+}
+
+void *weak_rc_upgrade(void *weak_data) {
+  return __rc_upgrade(__rc_check(__get_rc_header(weak_data)), weak_data);
 }
 
 #endif // ARC_IMPLEMENTATION
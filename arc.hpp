@@ -0,0 +1,246 @@
+///
+/// @title:        ARC (Atomic Reference Counting), C++ bindings
+///
+/// @description:  RAII arc::Arc<T> / arc::Weak<T> over the C api in arc.h
+///
+/// @license:      MIT
+///
+
+/// ### Usage
+/// Include this from C++ (11 or later) and build arc.h's implementation once
+/// in a C translation unit, same as any other user of arc.h...
+///
+///   auto config = arc::make_arc<Config>(args...);
+///   auto copy = config;                // arc_clone
+///   auto moved = std::move(config);    // no count traffic at all
+///   arc::Weak<Config> weak = moved.downgrade();
+///   if (auto alive = weak.upgrade()) { ... }
+///
+/// Moves only ever shuffle the pointer (and are noexcept), so containers of
+/// arcs reallocate without touching a single count. The last strong runs
+/// ~T(), resolved at compile time, with no destructor to pass around.
+
+#ifndef ARC_HPP
+#define ARC_HPP
+
+#include <new>
+#include <cerrno>
+#include <cstddef>
+#include <utility>
+#include <system_error>
+#include <type_traits>
+
+#include "arc.h"
+
+namespace arc {
+
+template <typename T> class Arc;
+template <typename T> class Weak;
+
+template <typename T, typename... Args> Arc<T> make_arc(Args &&...args);
+
+namespace detail {
+
+// the destructor arc_free runs once the last strong goes, trivially
+// destructible types get away without one...
+template <typename T> void destroy(void *data) noexcept {
+  static_cast<T *>(data)->~T();
+}
+
+template <typename T> constexpr void (*destructor())(void *) {
+  return std::is_trivially_destructible<T>::value ? nullptr : &destroy<T>;
+}
+
+// the c api reports a failed clone (too many refs) as NULL and errno, which
+// can't be swallowed by a copy constructor
+inline void *checked(void *data) {
+  if (data == nullptr) {
+    throw std::system_error(errno, std::generic_category());
+  }
+  return data;
+}
+
+} // namespace detail
+
+/// A strong reference to a T living in an arc, empty when default constructed
+/// or moved from
+template <typename T> class Arc {
+public:
+  Arc() noexcept = default;
+  Arc(std::nullptr_t) noexcept {}
+
+  /// Copying clones the arc, throwing std::system_error if the count is full
+  Arc(const Arc &other) : data_(other.data_ != nullptr ? clone(other.data_) : nullptr) {}
+  Arc(Arc &&other) noexcept : data_(other.data_) {
+    other.data_ = nullptr;
+  }
+
+  ~Arc() {
+    reset();
+  }
+
+  Arc &operator=(const Arc &other) {
+    Arc(other).swap(*this);
+    return *this;
+  }
+
+  Arc &operator=(Arc &&other) noexcept {
+    Arc(std::move(other)).swap(*this);
+    return *this;
+  }
+
+  /// Take over a strong ref from the c api, arc_data must hold a live T
+  static Arc adopt(T *arc_data) noexcept {
+    return Arc(arc_data);
+  }
+
+  /// Hand the strong ref back to the c api, leaving this empty
+  T *release() noexcept {
+    T *data = data_;
+    data_ = nullptr;
+    return data;
+  }
+
+  /// Drop the strong ref (if any), leaving this empty
+  void reset() noexcept {
+    if (data_ != nullptr) {
+      arc_free(release(), detail::destructor<T>());
+    }
+  }
+
+  void swap(Arc &other) noexcept {
+    std::swap(data_, other.data_);
+  }
+
+  /// A new weak ref to the same T
+  Weak<T> downgrade() const {
+    return Weak<T>(data_ != nullptr ? static_cast<T *>(detail::checked(arc_downgrade(data_))) : nullptr);
+  }
+
+  /// The T itself when nobody else can see it (see arc_get_mut), else NULL
+  T *get_mut() noexcept {
+    return data_ != nullptr ? static_cast<T *>(arc_get_mut(data_)) : nullptr;
+  }
+
+  T *get() const noexcept {
+    return data_;
+  }
+
+  T &operator*() const noexcept {
+    return *data_;
+  }
+
+  T *operator->() const noexcept {
+    return data_;
+  }
+
+  explicit operator bool() const noexcept {
+    return data_ != nullptr;
+  }
+
+  friend bool operator==(const Arc &lhs, const Arc &rhs) noexcept {
+    return lhs.data_ == rhs.data_;
+  }
+
+  friend bool operator!=(const Arc &lhs, const Arc &rhs) noexcept {
+    return lhs.data_ != rhs.data_;
+  }
+
+private:
+  friend class Weak<T>;
+  template <typename U, typename... Args> friend Arc<U> make_arc(Args &&...args);
+
+  explicit Arc(T *data) noexcept : data_(data) {}
+
+  static T *clone(T *data) {
+    return static_cast<T *>(detail::checked(arc_clone(data)));
+  }
+
+  T *data_ = nullptr;
+};
+
+/// A weak reference to a T living in an arc, upgraded to an Arc<T> for as
+/// long as any strong ref is still around
+template <typename T> class Weak {
+public:
+  Weak() noexcept = default;
+  Weak(std::nullptr_t) noexcept {}
+
+  Weak(const Weak &other) : data_(other.data_ != nullptr ? clone(other.data_) : nullptr) {}
+  Weak(Weak &&other) noexcept : data_(other.data_) {
+    other.data_ = nullptr;
+  }
+
+  ~Weak() {
+    reset();
+  }
+
+  Weak &operator=(const Weak &other) {
+    Weak(other).swap(*this);
+    return *this;
+  }
+
+  Weak &operator=(Weak &&other) noexcept {
+    Weak(std::move(other)).swap(*this);
+    return *this;
+  }
+
+  void reset() noexcept {
+    if (data_ != nullptr) {
+      weak_free(data_);
+      data_ = nullptr;
+    }
+  }
+
+  void swap(Weak &other) noexcept {
+    std::swap(data_, other.data_);
+  }
+
+  /// A strong ref to the T, or an empty Arc once the last strong has gone
+  Arc<T> upgrade() const noexcept {
+    return Arc<T>(data_ != nullptr ? static_cast<T *>(weak_upgrade(data_)) : nullptr);
+  }
+
+private:
+  friend class Arc<T>;
+
+  explicit Weak(T *data) noexcept : data_(data) {}
+
+  static T *clone(T *data) {
+    return static_cast<T *>(detail::checked(weak_clone(data)));
+  }
+
+  T *data_ = nullptr;
+};
+
+template <typename T> void swap(Arc<T> &lhs, Arc<T> &rhs) noexcept {
+  lhs.swap(rhs);
+}
+
+template <typename T> void swap(Weak<T> &lhs, Weak<T> &rhs) noexcept {
+  lhs.swap(rhs);
+}
+
+/// Construct a T in place inside a new arc, throwing std::bad_alloc when
+/// there's no memory (and passing on whatever T's constructor throws)
+template <typename T, typename... Args> Arc<T> make_arc(Args &&...args) {
+  // arc_new only promises pointer alignment...
+  void *data = alignof(T) > alignof(void *)
+    ? arc_new_aligned(sizeof(T), alignof(T))
+    : arc_new(sizeof(T));
+  if (data == nullptr) {
+    throw std::bad_alloc();
+  }
+  try {
+    ::new (data) T(std::forward<Args>(args)...);
+  } catch (...) {
+    // never got a T, so nothing to destroy
+    arc_free(data, nullptr);
+    throw;
+  }
+  return Arc<T>(static_cast<T *>(data));
+}
+
+} // namespace arc
+
+#endif // ARC_HPP
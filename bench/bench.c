@@ -0,0 +1,210 @@
+#include <stdio.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <time.h>
+
+// every CAS loop in the library that has to go round again ends up here...
+static _Thread_local size_t retries;
+#define ARC_ON_RETRY(site) ((void)(site), ++retries)
+
+#define ARC_IMPLEMENTATION
+#include "../arc.h"
+#undef ARC_IMPLEMENTATION
+
+// ops are timed in batches, so the clock itself stays out of the numbers
+#define BATCH 64
+#define BATCHES 4096
+#define MAX_THREADS 64
+
+typedef struct {
+  const char *name;
+  const char *mode;
+  size_t threads;
+  double ns_per_op;
+  double batch_avg_p50_ns;
+  double batch_avg_p99_ns;
+  double retries_per_op;
+} result_t;
+
+typedef struct {
+  // the hot arc everyone shares, or NULL for one arc per thread
+  void *shared;
+  pthread_barrier_t *barrier;
+  double samples[BATCHES];
+  size_t retries;
+  double elapsed_ns;
+} worker_t;
+
+static int first_result = 1;
+
+static double now_ns(void) {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (double) ts.tv_sec * 1e9 + (double) ts.tv_nsec;
+}
+
+static int compare_doubles(const void *a, const void *b) {
+  double x = *(const double *) a;
+  double y = *(const double *) b;
+  return (x > y) - (x < y);
+}
+
+static void print_result(const result_t *result) {
+  printf(
+    "%s\n    {\"name\": \"%s\", \"mode\": \"%s\", \"threads\": %zu, "
+    "\"ns_per_op\": %.2f, \"batch_avg_p50_ns\": %.2f, \"batch_avg_p99_ns\": %.2f, \"cas_retries_per_op\": %.4f}",
+    first_result ? "" : ",",
+    result->name, result->mode, result->threads,
+    result->ns_per_op, result->batch_avg_p50_ns, result->batch_avg_p99_ns, result->retries_per_op
+  );
+  first_result = 0;
+}
+
+// fold per-batch samples (ns per op) from every worker into one result...
+// the percentiles are over those batch averages, not single ops, since a
+// single op is too quick to time without the clock swamping it
+static void summarise(result_t *result, worker_t *workers, size_t threads) {
+  static double samples[MAX_THREADS * BATCHES];
+  size_t count = 0;
+  size_t total_retries = 0;
+  double elapsed_ns = 0;
+  for (size_t i = 0; i < threads; ++i) {
+    for (size_t j = 0; j < BATCHES; ++j) {
+      samples[count++] = workers[i].samples[j];
+    }
+    total_retries += workers[i].retries;
+    elapsed_ns = workers[i].elapsed_ns > elapsed_ns ? workers[i].elapsed_ns : elapsed_ns;
+  }
+  qsort(samples, count, sizeof(double), compare_doubles);
+  double ops = (double) threads * BATCHES * BATCH;
+  // wall time over every op any thread did, so it reads as throughput
+  result->ns_per_op = elapsed_ns / ops;
+  result->batch_avg_p50_ns = samples[count / 2];
+  result->batch_avg_p99_ns = samples[count * 99 / 100];
+  result->retries_per_op = (double) total_retries / ops;
+}
+
+static void *clone_free_worker(void *arg) {
+  worker_t *worker = arg;
+  void *arc = worker->shared != NULL ? worker->shared : arc_new(sizeof(int));
+  pthread_barrier_wait(worker->barrier);
+  retries = 0;
+  double start = now_ns();
+  for (size_t i = 0; i < BATCHES; ++i) {
+    double batch_start = now_ns();
+    for (size_t j = 0; j < BATCH; ++j) {
+      arc_free(arc_clone(arc), NULL);
+    }
+    worker->samples[i] = (now_ns() - batch_start) / BATCH;
+  }
+  worker->elapsed_ns = now_ns() - start;
+  worker->retries = retries;
+  if (worker->shared == NULL) {
+    arc_free(arc, NULL);
+  }
+  return NULL;
+}
+
+// the shared arc comes from make, or NULL for one arc per thread
+static void bench_clone_free(size_t threads, const char *mode, void *(*make)(size_t)) {
+  static worker_t workers[MAX_THREADS];
+  pthread_t handles[MAX_THREADS];
+  pthread_barrier_t barrier;
+  pthread_barrier_init(&barrier, NULL, (unsigned) threads);
+  void *shared = make != NULL ? make(sizeof(int)) : NULL;
+  for (size_t i = 0; i < threads; ++i) {
+    workers[i].shared = shared;
+    workers[i].barrier = &barrier;
+    pthread_create(&handles[i], NULL, clone_free_worker, &workers[i]);
+  }
+  for (size_t i = 0; i < threads; ++i) {
+    pthread_join(handles[i], NULL);
+  }
+  pthread_barrier_destroy(&barrier);
+  if (shared != NULL) {
+    arc_free(shared, NULL);
+  }
+  result_t result = {"clone_free", mode, threads, 0, 0, 0, 0};
+  summarise(&result, workers, threads);
+  print_result(&result);
+}
+
+static void bench_upgrade(int alive) {
+  static worker_t worker;
+  void *arc = arc_new(sizeof(int));
+  void *weak = arc_downgrade(arc);
+  if (!alive) {
+    arc_free(arc, NULL);
+  }
+  retries = 0;
+  double start = now_ns();
+  for (size_t i = 0; i < BATCHES; ++i) {
+    double batch_start = now_ns();
+    for (size_t j = 0; j < BATCH; ++j) {
+      void *upgraded = weak_upgrade(weak);
+      if (upgraded != NULL) {
+        arc_free(upgraded, NULL);
+      }
+    }
+    worker.samples[i] = (now_ns() - batch_start) / BATCH;
+  }
+  worker.elapsed_ns = now_ns() - start;
+  worker.retries = retries;
+  if (alive) {
+    arc_free(arc, NULL);
+  }
+  weak_free(weak);
+  result_t result = {"weak_upgrade", alive ? "success" : "failure", 1, 0, 0, 0, 0};
+  summarise(&result, &worker, 1);
+  print_result(&result);
+}
+
+static void bench_alloc(int raw) {
+  static worker_t worker;
+  retries = 0;
+  double start = now_ns();
+  for (size_t i = 0; i < BATCHES; ++i) {
+    double batch_start = now_ns();
+    for (size_t j = 0; j < BATCH; ++j) {
+      if (raw) {
+        // volatile, or the compiler is within its rights to drop the pair
+        void *volatile block = malloc(sizeof(int));
+        free(block);
+      } else {
+        arc_free(arc_new(sizeof(int)), NULL);
+      }
+    }
+    worker.samples[i] = (now_ns() - batch_start) / BATCH;
+  }
+  worker.elapsed_ns = now_ns() - start;
+  worker.retries = retries;
+  result_t result = {raw ? "malloc_free" : "arc_new_free", "single", 1, 0, 0, 0, 0};
+  summarise(&result, &worker, 1);
+  print_result(&result);
+}
+
+int main(int argc, char *argv[]) {
+  (void) argc;
+  (void) argv;
+  long cores = sysconf(_SC_NPROCESSORS_ONLN);
+  size_t max_threads = cores > 0 ? (size_t) cores : 1;
+  max_threads = max_threads > MAX_THREADS ? MAX_THREADS : max_threads;
+
+  printf("{\n  \"cores\": %zu,\n  \"results\": [", max_threads);
+  // 1, 2, 4... cores, and cores itself if that isn't a power of two
+  for (size_t threads = 1; ; threads *= 2) {
+    size_t run = threads < max_threads ? threads : max_threads;
+    bench_clone_free(run, "hot", arc_new);
+    bench_clone_free(run, "sharded", arc_new_sharded);
+    bench_clone_free(run, "per_thread", NULL);
+    if (run == max_threads) {
+      break;
+    }
+  }
+  bench_upgrade(1);
+  bench_upgrade(0);
+  bench_alloc(0);
+  bench_alloc(1);
+  printf("\n  ]\n}\n");
+  return 0;
+}
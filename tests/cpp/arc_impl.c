@@ -0,0 +1,4 @@
+// the implementation is c only, so c++ tests link against it from here...
+#define ARC_IMPLEMENTATION
+#include "../../arc.h"
+#undef ARC_IMPLEMENTATION
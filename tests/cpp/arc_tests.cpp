@@ -0,0 +1,125 @@
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+#include <stdexcept>
+
+#include "../../arc.hpp"
+
+#define THE_UNIVERSE_AND_EVERYTHING 42
+
+// NDEBUG disables assert, this will never be disabled
+#define ALWAYS_ASSERT(expr) \
+  ((expr) ? (void)0 : (std::fprintf(stderr, "Assertion failed at line %d: %s\n", __LINE__, #expr), std::exit(1)))
+
+static_assert(std::is_nothrow_move_constructible<arc::Arc<std::string>>::value, "moves must not throw");
+static_assert(std::is_nothrow_move_assignable<arc::Arc<std::string>>::value, "moves must not throw");
+static_assert(std::is_nothrow_move_constructible<arc::Weak<std::string>>::value, "moves must not throw");
+
+static int alive = 0;
+
+struct tracked_t {
+  int value;
+  explicit tracked_t(int value) : value(value) {
+    ++alive;
+  }
+  ~tracked_t() {
+    --alive;
+  }
+};
+
+struct throws_t {
+  throws_t() {
+    throw std::runtime_error("nope");
+  }
+};
+
+struct alignas(64) wide_t {
+  char bytes[64];
+};
+
+void test_arc() {
+  {
+    arc::Arc<tracked_t> arc = arc::make_arc<tracked_t>(THE_UNIVERSE_AND_EVERYTHING);
+    ALWAYS_ASSERT(alive == 1);
+    ALWAYS_ASSERT(arc->value == THE_UNIVERSE_AND_EVERYTHING);
+    ALWAYS_ASSERT(arc.get_mut() != nullptr);
+
+    arc::Arc<tracked_t> copy = arc;
+    ALWAYS_ASSERT(copy == arc);
+    ALWAYS_ASSERT(arc.get_mut() == nullptr);
+
+    // moving just hands the pointer over...
+    arc::Arc<tracked_t> moved = std::move(copy);
+    ALWAYS_ASSERT(!copy);
+    ALWAYS_ASSERT(moved == arc);
+    moved.reset();
+    ALWAYS_ASSERT(arc.get_mut() != nullptr);
+    ALWAYS_ASSERT(alive == 1);
+  }
+  // ~T runs with the last strong
+  ALWAYS_ASSERT(alive == 0);
+
+  auto text = arc::make_arc<std::string>(1000, 'x');
+  ALWAYS_ASSERT(text->size() == 1000);
+  auto wide = arc::make_arc<wide_t>();
+  ALWAYS_ASSERT(reinterpret_cast<uintptr_t>(wide.get()) % 64 == 0);
+}
+
+void test_weak() {
+  arc::Weak<tracked_t> weak;
+  ALWAYS_ASSERT(!weak.upgrade());
+  {
+    auto arc = arc::make_arc<tracked_t>(THE_UNIVERSE_AND_EVERYTHING);
+    weak = arc.downgrade();
+    arc::Weak<tracked_t> copy = weak;
+    auto upgraded = copy.upgrade();
+    ALWAYS_ASSERT(upgraded == arc);
+    ALWAYS_ASSERT(upgraded->value == THE_UNIVERSE_AND_EVERYTHING);
+  }
+  ALWAYS_ASSERT(alive == 0);
+  ALWAYS_ASSERT(!weak.upgrade());
+}
+
+void test_containers() {
+  std::vector<arc::Arc<tracked_t>> arcs;
+  arcs.push_back(arc::make_arc<tracked_t>(THE_UNIVERSE_AND_EVERYTHING));
+  // a thousand reallocations later it's still the only ref, nobody cloned it
+  for (int i = 0; i < 1000; ++i) {
+    arcs.push_back(arc::make_arc<tracked_t>(i));
+  }
+  ALWAYS_ASSERT(arcs.front().get_mut() != nullptr);
+  ALWAYS_ASSERT(arcs.front()->value == THE_UNIVERSE_AND_EVERYTHING);
+  ALWAYS_ASSERT(alive == 1001);
+  arcs.clear();
+  ALWAYS_ASSERT(alive == 0);
+}
+
+void test_throwing() {
+  bool caught = false;
+  try {
+    arc::make_arc<throws_t>();
+  } catch (const std::runtime_error &) {
+    caught = true;
+  }
+  ALWAYS_ASSERT(caught);
+
+  // round trips through the c api keep the ref it came with
+  auto arc = arc::make_arc<tracked_t>(THE_UNIVERSE_AND_EVERYTHING);
+  tracked_t *raw = arc.release();
+  ALWAYS_ASSERT(!arc);
+  arc = arc::Arc<tracked_t>::adopt(raw);
+  ALWAYS_ASSERT(arc->value == THE_UNIVERSE_AND_EVERYTHING);
+}
+
+int main() {
+  std::printf("Running C++ tests...\n");
+
+  test_arc();
+  test_weak();
+  test_containers();
+  test_throwing();
+
+  std::printf("All C++ tests passing...\n");
+  return 0;
+}
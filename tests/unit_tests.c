@@ -1,6 +1,17 @@
 #include <stdio.h>
+#include <stddef.h>
 #include <unistd.h>
 #include <pthread.h>
+#include <signal.h>
+#include <sys/wait.h>
+#include <sys/mman.h>
+#include <sys/syscall.h>
+#include <errno.h>
+
+// lets test_borrow_fallback play a kernel that won't run membarrier
+static int membarrier_broken;
+#define ARC_MEMBARRIER(cmd) \
+  (membarrier_broken ? (errno = ENOSYS, -1) : (int) syscall(SYS_membarrier, (cmd), 0))
 
 #define ARC_IMPLEMENTATION
 #include "../arc.h"
@@ -14,7 +25,7 @@
 
 // NDEBUG disables assert, this will never be disabled
 #define ALWAYS_ASSERT(expr) \
-  ((expr) ? (void)0 : (fprintf(stderr, "Assertion failed at line %d: %s\n", __LINE__, #expr), exit(0)))
+  ((expr) ? (void)0 : (fprintf(stderr, "Assertion failed at line %d: %s\n", __LINE__, #expr), exit(1)))
 
 typedef struct {
   int *shared_arc;
@@ -22,12 +33,18 @@ typedef struct {
 } test_data_t;
 
 void validate_reference_counts(arc_header_t *data, size_t expected_strong, size_t expected_weak) {
-  size_t strong_count = atomic_load_explicit(&data->strong_count, memory_order_relaxed);
-  size_t weak_count = atomic_load_explicit(&data->weak_count, memory_order_relaxed);
+  size_t strong_count = __arc_strong_count(data);
+  size_t weak_count = __arc_weak_count(data);
   ALWAYS_ASSERT(strong_count == expected_strong);
   ALWAYS_ASSERT(weak_count == expected_weak);
 }
 
+// the counts might share a word, so only overwrite the strong half of it
+void set_strong_count(arc_header_t *header, __arc_count_t count) {
+  __arc_word_t word = atomic_load(__ARC_STRONG(header)) & ~__ARC_MASK(__ARC_STRONG_SHIFT);
+  atomic_store(__ARC_STRONG(header), word | (__arc_word_t) count << __ARC_STRONG_SHIFT);
+}
+
 void *arc_operations(void *arg) {
   test_data_t *data = (test_data_t *)arg;
 
@@ -72,6 +89,9 @@ void test_arc() {
   int *shared_arc = arc_new(sizeof(int));
   ALWAYS_ASSERT(shared_arc != NULL);
   *shared_arc = THE_UNIVERSE_AND_EVERYTHING;
+  // plain arcs are just the two counts, no meta in front
+  ALWAYS_ASSERT(!__arc_prefixed(__get_header(shared_arc)));
+  ALWAYS_ASSERT(__arc_flags(__get_header(shared_arc)) == __ARC_FLAGS_PLAIN);
 
   int *shared_weak = arc_downgrade(shared_arc);
   ALWAYS_ASSERT(shared_weak != NULL);
@@ -108,13 +128,1605 @@ void test_arc() {
   weak_free(shared_weak);
 }
 
+typedef struct {
+  atomic_size_t allocs;
+  atomic_size_t frees;
+} counting_allocator_t;
+
+void *counting_alloc(void *ctx, size_t nbytes) {
+  counting_allocator_t *counts = ctx;
+  atomic_fetch_add(&counts->allocs, 1);
+  return malloc(nbytes);
+}
+
+void counting_free(void *ctx, void *ptr) {
+  counting_allocator_t *counts = ctx;
+  atomic_fetch_add(&counts->frees, 1);
+  free(ptr);
+}
+
+void test_allocator() {
+  counting_allocator_t counts = {0, 0};
+  arc_allocator_t allocator = {counting_alloc, counting_free, &counts, NULL};
+
+  int *arc = arc_new_in(&allocator, sizeof(int));
+  ALWAYS_ASSERT(arc != NULL);
+  *arc = THE_UNIVERSE_AND_EVERYTHING;
+  ALWAYS_ASSERT(counts.allocs == 1);
+
+  int *clone = arc_clone(arc);
+  int *weak = arc_downgrade(arc);
+  validate_reference_counts(__get_header(arc), 2, 2);
+  arc_free(clone, NULL);
+  arc_free(arc, NULL);
+  // the weak is still holding on to the block...
+  ALWAYS_ASSERT(counts.frees == 0);
+  ALWAYS_ASSERT(weak_upgrade(weak) == NULL);
+  weak_free(weak);
+  ALWAYS_ASSERT(counts.frees == 1);
+
+  // plain arc_new goes through whatever was installed globally
+  arc_set_allocator(&allocator);
+  int *global = arc_new(sizeof(int));
+  ALWAYS_ASSERT(global != NULL);
+  ALWAYS_ASSERT(counts.allocs == 2);
+  arc_free(global, NULL);
+  ALWAYS_ASSERT(counts.frees == 2);
+  arc_set_allocator(NULL);
+}
+
+void test_aligned() {
+  size_t aligns[] = {16, 32, 64, 4096};
+  for (size_t i = 0; i < sizeof(aligns) / sizeof(aligns[0]); ++i) {
+    uint8_t *arc = arc_new_aligned(100, aligns[i]);
+    ALWAYS_ASSERT(arc != NULL);
+    ALWAYS_ASSERT((uintptr_t) arc % aligns[i] == 0);
+    memset(arc, THE_UNIVERSE_AND_EVERYTHING, 100);
+    uint8_t *weak = arc_downgrade(arc);
+    uint8_t *clone = arc_clone(arc);
+    validate_reference_counts(__get_header(arc), 2, 2);
+    arc_free(clone, NULL);
+    arc_free(arc, NULL);
+    ALWAYS_ASSERT(weak_upgrade(weak) == NULL);
+    weak_free(weak);
+  }
+
+  errno = 0;
+  ALWAYS_ASSERT(arc_new_aligned(8, 24) == NULL);
+  ALWAYS_ASSERT(errno == EINVAL);
+
+  uint8_t *isolated = arc_new_isolated(sizeof(int));
+  ALWAYS_ASSERT(isolated != NULL);
+  ALWAYS_ASSERT((uintptr_t) isolated % ARC_CACHE_LINE_SIZE == 0);
+  // the whole line holding the header belongs to our block...
+  arc_header_t *header = __get_header(isolated);
+  uint8_t *block = (uint8_t *) header - __arc_offset(header);
+  ALWAYS_ASSERT(block <= isolated - ARC_CACHE_LINE_SIZE);
+  arc_free(isolated, NULL);
+}
+
+atomic_int destroyed;
+
+void count_destroyed(void *data) {
+  (void) data;
+  atomic_fetch_add(&destroyed, 1);
+}
+
+void *biased_operations(void *arg) {
+  test_data_t *data = (test_data_t *)arg;
+
+  for (int i = 0; i < NUM_OPERATIONS; ++i) {
+    int *clone = arc_clone(data->shared_arc);
+    ALWAYS_ASSERT(clone != NULL);
+    ALWAYS_ASSERT(*clone == THE_UNIVERSE_AND_EVERYTHING);
+    arc_free(clone, count_destroyed);
+
+    int *upgraded = weak_upgrade(data->shared_weak);
+    ALWAYS_ASSERT(upgraded != NULL);
+    arc_free(upgraded, count_destroyed);
+  }
+
+  return NULL;
+}
+
+void *biased_drop(void *arg) {
+  arc_free(arg, count_destroyed);
+  return NULL;
+}
+
+void test_with_dtor() {
+  atomic_store(&destroyed, 0);
+  int *arc = arc_new_with_dtor(sizeof(int), count_destroyed);
+  ALWAYS_ASSERT(arc != NULL);
+  ALWAYS_ASSERT(arc_size(arc) == sizeof(int));
+  ALWAYS_ASSERT(__arc_prefixed(__get_header(arc)) && (__arc_flags(__get_header(arc)) & __ARC_FLAG_EXT));
+  int *clone = arc_clone(arc);
+  arc_free(clone, NULL);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 0);
+  // no destructor at the call site, the recorded one runs anyway
+  arc_free(arc, NULL);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 1);
+
+  // and an explicit one still takes precedence
+  arc = arc_new_with_dtor(sizeof(int), NULL);
+  arc_free(arc, count_destroyed);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 2);
+
+  // plain arcs keep the header lean, so they know neither
+  int *plain = arc_new(sizeof(int));
+  ALWAYS_ASSERT(arc_size(plain) == 0);
+  arc_free(plain, NULL);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 2);
+}
+
+void test_constructors() {
+  atomic_store(&destroyed, 0);
+  // big enough to come straight from mmap, small enough for a slab
+  size_t sizes[] = {sizeof(int), 64, 1 << 20};
+  for (size_t i = 0; i < sizeof(sizes) / sizeof(sizes[0]); ++i) {
+    // dirty whatever the allocator hands back next...
+    uint8_t *dirty = arc_new(sizes[i]);
+    memset(dirty, 0xAB, sizes[i]);
+    arc_free(dirty, NULL);
+    uint8_t *zeroed = arc_new_zeroed(sizes[i]);
+    ALWAYS_ASSERT(zeroed != NULL);
+    for (size_t j = 0; j < sizes[i]; ++j) {
+      ALWAYS_ASSERT(zeroed[j] == 0);
+    }
+    arc_free(zeroed, NULL);
+  }
+  ALWAYS_ASSERT(arc_new_zeroed(0) == NULL);
+
+  int values[] = {1, 2, 3};
+  int *copied = arc_from_copy(values, sizeof(values));
+  ALWAYS_ASSERT(copied != NULL && memcmp(copied, values, sizeof(values)) == 0);
+  arc_free(copied, NULL);
+
+  // the multiplication is checked, not wrapped
+  ALWAYS_ASSERT(arc_new_array(SIZE_MAX / 2, 3) == NULL && errno == ENOMEM);
+  ALWAYS_ASSERT(arc_new_array(0, sizeof(int)) == NULL);
+
+  int *array = arc_new_array_with_dtor(10, sizeof(int), count_destroyed);
+  ALWAYS_ASSERT(array != NULL);
+  ALWAYS_ASSERT(arc_array_len(array) == 10);
+  ALWAYS_ASSERT(arc_size(array) == 10 * sizeof(int));
+  int *clone = arc_clone(array);
+  arc_free(clone, NULL);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 0);
+  // once per element, with nothing passed at the call site
+  arc_free(array, NULL);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 10);
+
+  // copies on write stay arrays with the same element destructor
+  array = arc_new_array_with_dtor(4, sizeof(int), count_destroyed);
+  memcpy(array, values, sizeof(values));
+  clone = arc_clone(array);
+  int *unshared = arc_make_mut(clone, 0, NULL, NULL);
+  ALWAYS_ASSERT(unshared != array && arc_array_len(unshared) == 4);
+  ALWAYS_ASSERT(memcmp(unshared, values, sizeof(values)) == 0);
+  arc_free(array, NULL);
+  arc_free(unshared, NULL);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 18);
+
+  int *plain = arc_new_array(3, sizeof(int));
+  ALWAYS_ASSERT(arc_array_len(plain) == 3);
+  arc_free(plain, NULL);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 18);
+}
+
+void test_mapped() {
+  atomic_store(&destroyed, 0);
+  unsigned modes[] = {0, ARC_MAP_THP, ARC_MAP_HUGETLB | ARC_MAP_POPULATE};
+  for (size_t i = 0; i < sizeof(modes) / sizeof(modes[0]); ++i) {
+    // with no huge pages reserved, hugetlb quietly settles for less
+    uint8_t *mapped = arc_new_mapped(1 << 20, modes[i]);
+    ALWAYS_ASSERT(mapped != NULL);
+    ALWAYS_ASSERT(arc_size(mapped) == 1 << 20);
+    memset(mapped, 0xAB, 1 << 20);
+    uint8_t *weak = arc_downgrade(mapped);
+    arc_free(mapped, count_destroyed);
+    ALWAYS_ASSERT(weak_upgrade(weak) == NULL);
+    weak_free(weak);
+  }
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 3);
+  ALWAYS_ASSERT(arc_new_mapped(1 << 20, 1 << 3) == NULL && errno == EINVAL);
+
+  // big enough and arc_new maps it by itself, which is how it knows its size
+  uint8_t *big = arc_new(ARC_MAP_THRESHOLD);
+  ALWAYS_ASSERT(big != NULL && arc_size(big) == ARC_MAP_THRESHOLD);
+  big[ARC_MAP_THRESHOLD - 1] = 1;
+  arc_free(big, NULL);
+
+  char path[] = "/tmp/arc_mapped_XXXXXX";
+  int fd = mkstemp(path);
+  ALWAYS_ASSERT(fd >= 0);
+  const char contents[] = "the answer is 42";
+  ALWAYS_ASSERT(write(fd, contents, sizeof(contents)) == (ssize_t) sizeof(contents));
+  close(fd);
+  size_t nbytes = 0;
+  char *file = arc_map_file(path, &nbytes);
+  unlink(path);
+  ALWAYS_ASSERT(file != NULL && nbytes == sizeof(contents));
+  ALWAYS_ASSERT(memcmp(file, contents, sizeof(contents)) == 0);
+  ALWAYS_ASSERT(((uintptr_t) file & (sysconf(_SC_PAGESIZE) - 1)) == 0);
+  // read-only, so writes have to go through a copy
+  ALWAYS_ASSERT(arc_get_mut(file) == NULL);
+  char *copy = arc_make_mut(arc_clone(file), 0, NULL, NULL);
+  ALWAYS_ASSERT(copy != file && memcmp(copy, contents, sizeof(contents)) == 0);
+  copy[0] = 'T';
+  arc_free(copy, NULL);
+  arc_free(file, NULL);
+
+  ALWAYS_ASSERT(arc_map_file("/nonexistent/arc", NULL) == NULL && errno == ENOENT);
+  ALWAYS_ASSERT(arc_map_file("/tmp", NULL) == NULL && errno == EINVAL);
+}
+
+void test_numa() {
+  // nodes may not exist past 0, but placement is only ever a preference
+  int nodes[] = {0, ARC_NODE_LOCAL};
+  for (size_t i = 0; i < sizeof(nodes) / sizeof(nodes[0]); ++i) {
+    uint8_t *placed = arc_new_on_node(1 << 16, nodes[i]);
+    ALWAYS_ASSERT(placed != NULL && arc_size(placed) == 1 << 16);
+    memset(placed, 0xCD, 1 << 16);
+    int node = arc_node_of(placed);
+    ALWAYS_ASSERT(node >= 0 || errno == ENOSYS || errno == EPERM);
+    uint8_t *weak = arc_downgrade(placed);
+    arc_free(placed, NULL);
+    weak_free(weak);
+  }
+  int current = arc_current_node();
+  ALWAYS_ASSERT(current >= 0 || errno == ENOSYS);
+
+  // or plugged in wherever an allocator goes
+  const arc_allocator_t *local = arc_node_allocator(ARC_NODE_LOCAL);
+  ALWAYS_ASSERT(local != NULL && local == arc_node_allocator(ARC_NODE_LOCAL));
+  int *arc = arc_new_in(local, sizeof(int));
+  ALWAYS_ASSERT(arc != NULL);
+  *arc = THE_UNIVERSE_AND_EVERYTHING;
+  int *clone = arc_clone(arc);
+  arc_free(arc, NULL);
+  ALWAYS_ASSERT(*clone == THE_UNIVERSE_AND_EVERYTHING);
+  arc_free(clone, NULL);
+
+  // small ones share a slab, and a freed block goes back to it for the next
+  uint8_t *first = arc_new_on_node(8, 0);
+  uint8_t *second = arc_new_on_node(8, 0);
+  ALWAYS_ASSERT(first != NULL && second != NULL);
+  uintptr_t apart = (uintptr_t) second > (uintptr_t) first
+    ? (uintptr_t) second - (uintptr_t) first : (uintptr_t) first - (uintptr_t) second;
+  ALWAYS_ASSERT(apart < ARC_NODE_SLAB_SIZE);
+  uint8_t *block = (uint8_t *) __get_header(first) - __arc_offset(__get_header(first));
+  ALWAYS_ASSERT(*(uintptr_t *)(block - __ARC_MAP_LEAD) & 1);
+  arc_free(first, NULL);
+  ALWAYS_ASSERT(arc_new_on_node(8, 0) == first);
+  arc_free(first, NULL);
+  arc_free(second, NULL);
+
+  ALWAYS_ASSERT(arc_node_allocator(ARC_MAX_NODES) == NULL && errno == EINVAL);
+  ALWAYS_ASSERT(arc_new_on_node(sizeof(int), -2) == NULL && errno == EINVAL);
+}
+
+void *downgrade_operations(void *arg) {
+  for (int i = 0; i < NUM_OPERATIONS; ++i) {
+    int *weak = arc_downgrade(arg);
+    ALWAYS_ASSERT(weak != NULL);
+    weak_free(weak);
+  }
+  return NULL;
+}
+
+void copy_doubled(void *dst, const void *src) {
+  *(int *) dst = *(const int *) src * 2;
+}
+
+void test_get_mut() {
+  atomic_store(&destroyed, 0);
+  int *arc = arc_new(sizeof(int));
+  *arc = THE_UNIVERSE_AND_EVERYTHING;
+  ALWAYS_ASSERT(arc_get_mut(arc) == arc);
+  int *clone = arc_clone(arc);
+  ALWAYS_ASSERT(arc_get_mut(arc) == NULL);
+  arc_free(clone, count_destroyed);
+  int *weak = arc_downgrade(arc);
+  ALWAYS_ASSERT(arc_get_mut(arc) == NULL);
+  weak_free(weak);
+  ALWAYS_ASSERT(arc_get_mut(arc) == arc);
+
+  // shared means a copy, leaving the original to whoever else holds it
+  clone = arc_clone(arc);
+  int *copied = arc_make_mut(clone, sizeof(int), NULL, count_destroyed);
+  ALWAYS_ASSERT(copied != NULL && copied != arc && *copied == THE_UNIVERSE_AND_EVERYTHING);
+  validate_reference_counts(__get_header(arc), 1, 1);
+  int *doubled = arc_make_mut(arc_clone(copied), sizeof(int), copy_doubled, count_destroyed);
+  ALWAYS_ASSERT(*doubled == THE_UNIVERSE_AND_EVERYTHING * 2);
+  // and unique means no copy at all
+  ALWAYS_ASSERT(arc_make_mut(arc, sizeof(int), NULL, count_destroyed) == arc);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 0);
+
+  // the last ref going through make_mut destroys the original on the way
+  int *recorded = arc_new_with_dtor(sizeof(int), count_destroyed);
+  int *other = arc_clone(recorded);
+  int *recopied = arc_make_mut(other, 0, NULL, NULL);
+  arc_free(recorded, NULL);
+  arc_free(recopied, NULL);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 2);
+
+  // downgrades racing a uniqueness check wait for it, never fail
+  pthread_t thread;
+  int *racing = arc_clone(arc);
+  pthread_create(&thread, NULL, downgrade_operations, racing);
+  for (int i = 0; i < NUM_OPERATIONS; ++i) {
+    ALWAYS_ASSERT(arc_get_mut(arc) == NULL);
+  }
+  pthread_join(thread, NULL);
+  arc_free(racing, NULL);
+
+  int *biased = arc_new_biased(sizeof(int));
+  ALWAYS_ASSERT(arc_get_mut(biased) == biased);
+  int *local = arc_clone(biased);
+  ALWAYS_ASSERT(arc_get_mut(biased) == NULL);
+  arc_free(local, NULL);
+  ALWAYS_ASSERT(arc_get_mut(biased) == biased);
+  arc_free(biased, NULL);
+
+  int *rc = rc_new(sizeof(int));
+  ALWAYS_ASSERT(rc_get_mut(rc) == rc);
+  int *rc_weak = rc_downgrade(rc);
+  ALWAYS_ASSERT(rc_get_mut(rc) == NULL);
+  weak_rc_free(rc_weak);
+  rc_free(rc, NULL);
+
+  arc_free(arc, NULL);
+  arc_free(copied, NULL);
+  arc_free(doubled, NULL);
+}
+
+void test_unwrap() {
+  int out = 0;
+  int *arc = arc_new(sizeof(int));
+  *arc = THE_UNIVERSE_AND_EVERYTHING;
+  int *clone = arc_clone(arc);
+  errno = 0;
+  ALWAYS_ASSERT(arc_try_unwrap(arc, &out, sizeof(int)) == -1 && errno == EBUSY);
+  ALWAYS_ASSERT(arc_realloc(arc, 2 * sizeof(int)) == NULL && errno == EBUSY);
+  arc_free(clone, NULL);
+  // a plain arc has no size to fall back on
+  ALWAYS_ASSERT(arc_try_unwrap(arc, &out, 0) == -1 && errno == EINVAL);
+  validate_reference_counts(__get_header(arc), 1, 1);
+  ALWAYS_ASSERT(arc_try_unwrap(arc, &out, sizeof(int)) == 0);
+  ALWAYS_ASSERT(out == THE_UNIVERSE_AND_EVERYTHING);
+
+  // grow a buffer we own outright, keeping what we already wrote
+  char *buffer = arc_new(16);
+  memcpy(buffer, "arc", 4);
+  for (size_t nbytes = 32; nbytes <= 4096; nbytes *= 2) {
+    buffer = arc_realloc(buffer, nbytes);
+    ALWAYS_ASSERT(buffer != NULL && strcmp(buffer, "arc") == 0);
+    buffer[nbytes - 1] = 'x';
+  }
+  validate_reference_counts(__get_header(buffer), 1, 1);
+  int *weak = arc_downgrade(buffer);
+  ALWAYS_ASSERT(arc_realloc(buffer, 16) == NULL && errno == EBUSY);
+  weak_free(weak);
+  buffer = arc_realloc(buffer, 8);
+  ALWAYS_ASSERT(buffer != NULL && strcmp(buffer, "arc") == 0);
+  arc_free(buffer, NULL);
+
+  char *aligned = arc_new_aligned(16, 64);
+  ALWAYS_ASSERT(arc_realloc(aligned, 32) == NULL && errno == EINVAL);
+  arc_free(aligned, NULL);
+
+  // no realloc in the allocator, so it moves by hand (and remembers the size)
+  counting_allocator_t counts = {0, 0};
+  arc_allocator_t allocator = {counting_alloc, counting_free, &counts, NULL};
+  char *custom = arc_new_in(&allocator, 4);
+  memcpy(custom, "arc", 4);
+  custom = arc_realloc(custom, 1024);
+  ALWAYS_ASSERT(custom != NULL && strcmp(custom, "arc") == 0);
+  ALWAYS_ASSERT(arc_size(custom) == 1024);
+  ALWAYS_ASSERT(counts.allocs == 2 && counts.frees == 1);
+  arc_free(custom, NULL);
+  ALWAYS_ASSERT(counts.frees == 2);
+}
+
+typedef struct {
+  int fd;
+  ARC_INTRUSIVE_HEADER;
+  int in_use;
+} connection_t;
+
+void release_connection(arc_header_t *header) {
+  connection_t *connection = (connection_t *)((char *) header - offsetof(connection_t, arc_header));
+  connection->in_use = 0;
+  atomic_fetch_add(&destroyed, 1);
+}
+
+void *intrusive_operations(void *arg) {
+  connection_t *connection = arg;
+  for (int i = 0; i < NUM_OPERATIONS; ++i) {
+    arc_header_t *clone = arc_intrusive_clone(&connection->arc_header);
+    ALWAYS_ASSERT(clone == &connection->arc_header);
+    ALWAYS_ASSERT(connection->in_use);
+    arc_intrusive_release(clone, release_connection);
+  }
+  return NULL;
+}
+
+void test_intrusive() {
+  atomic_store(&destroyed, 0);
+  // lives on our stack, the arc never owns it
+  connection_t connection = {.fd = 3, .in_use = 1};
+  arc_intrusive_init(&connection.arc_header);
+  validate_reference_counts(&connection.arc_header, 1, 1);
+
+  pthread_t threads[NUM_THREADS / 10];
+  for (int i = 0; i < NUM_THREADS / 10; ++i) {
+    pthread_create(&threads[i], NULL, intrusive_operations, &connection);
+  }
+  for (int i = 0; i < NUM_THREADS / 10; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 0);
+  validate_reference_counts(&connection.arc_header, 1, 1);
+  arc_intrusive_release(&connection.arc_header, release_connection);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 1 && !connection.in_use);
+}
+
+#define SHM_SIZE ((size_t) 1 << 20)
+
+void *shm_operations(void *arg) {
+  for (int i = 0; i < NUM_OPERATIONS / 10; ++i) {
+    int *arc = arc_shm_new(arg, sizeof(int) * (1 + i % 64));
+    ALWAYS_ASSERT(arc != NULL);
+    *arc = THE_UNIVERSE_AND_EVERYTHING;
+    arc_free(arc, NULL);
+  }
+  return NULL;
+}
+
+void test_shm() {
+  void *region = mmap(NULL, SHM_SIZE, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  ALWAYS_ASSERT(region != MAP_FAILED);
+  ALWAYS_ASSERT(arc_shm_init(region, SHM_SIZE) == 0);
+  int *arc = arc_shm_new(region, sizeof(int));
+  ALWAYS_ASSERT(arc != NULL);
+  *arc = THE_UNIVERSE_AND_EVERYTHING;
+  int *weak = arc_downgrade(arc);
+  uint64_t offset = arc_shm_offset(region, arc_clone(arc));
+  uint64_t weak_offset = arc_shm_offset(region, weak_clone(weak));
+
+  // the child takes over a strong and a weak, and drops them its own way
+  pid_t child = fork();
+  if (child == 0) {
+    int *theirs = arc_shm_at(region, offset);
+    int *their_weak = arc_shm_at(region, weak_offset);
+    ALWAYS_ASSERT(*theirs == THE_UNIVERSE_AND_EVERYTHING);
+    int *upgraded = weak_upgrade(their_weak);
+    ALWAYS_ASSERT(upgraded == theirs);
+    arc_free(upgraded, NULL);
+    arc_free(theirs, NULL);
+    weak_free(their_weak);
+    _exit(0);
+  }
+  int status;
+  waitpid(child, &status, 0);
+  ALWAYS_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+  validate_reference_counts(__get_header(arc), 1, 2);
+  arc_free(arc, NULL);
+  ALWAYS_ASSERT(weak_upgrade(weak) == NULL);
+  weak_free(weak);
+
+  // freed blocks get reused rather than eating the region
+  int *first = arc_shm_new(region, sizeof(int));
+  arc_free(first, NULL);
+  int *again = arc_shm_new(region, sizeof(int));
+  ALWAYS_ASSERT(again == first);
+  arc_free(again, NULL);
+
+  pthread_t threads[NUM_THREADS / 10];
+  for (int i = 0; i < NUM_THREADS / 10; ++i) {
+    pthread_create(&threads[i], NULL, shm_operations, region);
+  }
+  for (int i = 0; i < NUM_THREADS / 10; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  errno = 0;
+  ALWAYS_ASSERT(arc_shm_new(region, SHM_SIZE) == NULL && errno == ENOMEM);
+  int *after = arc_shm_new(region, sizeof(int));
+  ALWAYS_ASSERT(after != NULL);
+  arc_free(after, NULL);
+  munmap(region, SHM_SIZE);
+}
+
+void test_bytes() {
+  atomic_store(&destroyed, 0);
+  char *frame = arc_new_with_dtor(16, count_destroyed);
+  memcpy(frame, "GET /index HTTP", 16);
+  arc_bytes_t bytes = arc_bytes_from(frame, 15);
+
+  arc_bytes_t method = arc_bytes_split_to(&bytes, 4);
+  ALWAYS_ASSERT(method.len == 4 && memcmp(arc_bytes_data(method), "GET ", 4) == 0);
+  arc_bytes_t version = arc_bytes_split_off(&bytes, 6);
+  ALWAYS_ASSERT(version.len == 5 && memcmp(arc_bytes_data(version), " HTTP", 5) == 0);
+  ALWAYS_ASSERT(bytes.len == 6 && memcmp(arc_bytes_data(bytes), "/index", 6) == 0);
+  arc_bytes_t path = arc_bytes_slice(bytes, 1, 6);
+  ALWAYS_ASSERT(arc_bytes_data(path) == (uint8_t *) frame + 5 && path.len == 5);
+  // every view is one more ref to the one frame, never a copy
+  validate_reference_counts(__get_header(frame), 4, 1);
+
+  errno = 0;
+  arc_bytes_t bad = arc_bytes_slice(bytes, 2, 7);
+  ALWAYS_ASSERT(bad.header == NULL && errno == EINVAL);
+  ALWAYS_ASSERT(arc_bytes_split_to(&bytes, 7).header == NULL && bytes.len == 6);
+
+  arc_bytes_free(&method);
+  arc_bytes_free(&version);
+  arc_bytes_free(&bytes);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 0);
+  arc_bytes_free(&path);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 1 && path.header == NULL);
+}
+
+// makes a biased arc and hands a ref back, leaving before it ever polls...
+void *biased_orphan(void *arg) {
+  int *owned = arc_new_biased(sizeof(int));
+  ALWAYS_ASSERT(owned != NULL);
+  *(int **) arg = arc_clone(owned);
+  arc_free(owned, count_destroyed);
+  // and one that goes in the queue while we're still around
+  int *queued = arc_new_biased(sizeof(int));
+  pthread_t thread;
+  pthread_create(&thread, NULL, biased_drop, arc_clone(queued));
+  pthread_join(thread, NULL);
+  arc_free(queued, count_destroyed);
+  return NULL;
+}
+
+void test_biased() {
+  atomic_store(&destroyed, 0);
+  int *shared_arc = arc_new_biased(sizeof(int));
+  ALWAYS_ASSERT(shared_arc != NULL);
+  *shared_arc = THE_UNIVERSE_AND_EVERYTHING;
+  int *shared_weak = arc_downgrade(shared_arc);
+
+  // owner side clones never touch strong_count...
+  int *local = arc_clone(shared_arc);
+  validate_reference_counts(__get_header(shared_arc), 1, 2);
+
+  test_data_t data = {shared_arc, shared_weak};
+  pthread_t threads[NUM_THREADS / 10];
+  for (int i = 0; i < NUM_THREADS / 10; ++i) {
+    pthread_create(&threads[i], NULL, biased_operations, &data);
+  }
+  for (int i = 0; i < NUM_OPERATIONS; ++i) {
+    int *upgraded = weak_upgrade(shared_weak);
+    ALWAYS_ASSERT(upgraded != NULL);
+    arc_free(upgraded, count_destroyed);
+  }
+  for (int i = 0; i < NUM_THREADS / 10; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 0);
+
+  // hand our remaining refs off to other threads to drop, leaving the owner
+  // with nothing... only a merge from the owner can spot that
+  pthread_t thread;
+  pthread_create(&thread, NULL, biased_drop, local);
+  pthread_join(thread, NULL);
+  pthread_create(&thread, NULL, biased_drop, shared_arc);
+  pthread_join(thread, NULL);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 0);
+  arc_biased_poll();
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 1);
+  validate_reference_counts(__get_header(shared_weak), 0, 1);
+  ALWAYS_ASSERT(weak_upgrade(shared_weak) == NULL);
+  weak_free(shared_weak);
+
+  // and the happy path, where the owner drops the last ref itself
+  int *owned = arc_new_biased(sizeof(int));
+  arc_free(arc_clone(owned), count_destroyed);
+  arc_free(owned, count_destroyed);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 2);
+
+  // an owner that exits merges whatever was queued on the way out, and
+  // leaves the rest for whoever drops the last ref
+  int *orphan = NULL;
+  pthread_create(&thread, NULL, biased_orphan, &orphan);
+  pthread_join(thread, NULL);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 3);
+  ALWAYS_ASSERT(orphan != NULL && !__arc_biased_is_owner(__get_biased(__get_header(orphan))));
+  arc_free(orphan, count_destroyed);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 4);
+}
+
+void *sharded_upgrades(void *arg) {
+  int *weak = arg;
+  int *upgraded;
+  while ((upgraded = weak_upgrade(weak)) != NULL) {
+    ALWAYS_ASSERT(*upgraded == THE_UNIVERSE_AND_EVERYTHING);
+    arc_free(upgraded, count_destroyed);
+  }
+  weak_free(weak);
+  return NULL;
+}
+
+void *sharded_clone(void *arg) {
+  return arc_clone(arg);
+}
+
+void test_sharded() {
+  atomic_store(&destroyed, 0);
+  int *shared_arc = arc_new_sharded(sizeof(int));
+  ALWAYS_ASSERT(shared_arc != NULL);
+  *shared_arc = THE_UNIVERSE_AND_EVERYTHING;
+  ALWAYS_ASSERT(arc_size(shared_arc) == sizeof(int));
+  int *shared_weak = arc_downgrade(shared_arc);
+
+  // strong_count sits at 1 while the shards do the counting...
+  int *local = arc_clone(shared_arc);
+  validate_reference_counts(__get_header(shared_arc), 1, 2);
+  ALWAYS_ASSERT(arc_get_mut(shared_arc) == NULL);
+
+  test_data_t data = {shared_arc, shared_weak};
+  pthread_t threads[NUM_THREADS / 10];
+  for (int i = 0; i < NUM_THREADS / 10; ++i) {
+    pthread_create(&threads[i], NULL, biased_operations, &data);
+  }
+  for (int i = 0; i < NUM_THREADS / 10; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 0);
+
+  // refs taken on one shard and dropped on another are borrowed back from
+  // the shard that counted them, leaving every shard open
+  pthread_t thread;
+  pthread_create(&thread, NULL, biased_drop, local);
+  pthread_join(thread, NULL);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 0);
+  arc_sharded_t *sharded = __get_sharded(__get_header(shared_arc));
+  for (size_t i = 0; i < ARC_SHARDS; ++i) {
+    ALWAYS_ASSERT(atomic_load(&sharded->shards[i].count) == 0);
+  }
+  // the same goes for central's ref, so long as someone else holds one...
+  pthread_create(&thread, NULL, sharded_clone, shared_arc);
+  pthread_join(thread, (void **) &local);
+  weak_free(shared_weak);
+  arc_free(shared_arc, count_destroyed);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 0);
+  ALWAYS_ASSERT(atomic_load(&sharded->shards[ARC_SHARDS - 1].count) == 0);
+  // and only the last of them folds it all back
+  arc_free(local, count_destroyed);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 1);
+
+  // refs cloned on two other threads and dropped here in one go get
+  // borrowed back a bit from each shard, still without closing up... the
+  // threads are pinned to the shards after ours so they don't share one
+  int *spread = arc_new_sharded(sizeof(int));
+  sharded = __get_sharded(__get_header(spread));
+  int *clones[2];
+  for (int i = 0; i < 2; ++i) {
+    atomic_store(&__arc_shard_next, __arc_shard_slot + 1 + i);
+    pthread_create(&thread, NULL, sharded_clone, spread);
+    pthread_join(thread, (void **) &clones[i]);
+    ALWAYS_ASSERT(clones[i] == spread);
+  }
+  arc_free_n(spread, 2, count_destroyed);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 1);
+  for (size_t i = 0; i < ARC_SHARDS; ++i) {
+    ALWAYS_ASSERT(atomic_load(&sharded->shards[i].count) == 0);
+  }
+  ALWAYS_ASSERT(atomic_load(&sharded->central.count) == 1);
+  arc_free(spread, count_destroyed);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 2);
+
+  // the last few refs all going at once (with upgrades racing them) still
+  // destroy it exactly once
+  for (int round = 0; round < 100; ++round) {
+    int *arc = arc_new_sharded(sizeof(int));
+    *arc = THE_UNIVERSE_AND_EVERYTHING;
+    pthread_create(&thread, NULL, sharded_upgrades, arc_downgrade(arc));
+    for (int i = 0; i < NUM_THREADS / 10; ++i) {
+      pthread_create(&threads[i], NULL, biased_drop, arc_clone(arc));
+    }
+    arc_free(arc, count_destroyed);
+    for (int i = 0; i < NUM_THREADS / 10; ++i) {
+      pthread_join(threads[i], NULL);
+    }
+    pthread_join(thread, NULL);
+    ALWAYS_ASSERT(atomic_load(&destroyed) == round + 3);
+  }
+}
+
+void *intern_operations(void *arg) {
+  static const char *words[] = {"alpha", "beta", "gamma", "delta"};
+  for (int i = 0; i < NUM_OPERATIONS / 10; ++i) {
+    const char *word = words[i % 4];
+    char *first = arc_intern(arg, word, strlen(word) + 1);
+    char *again = arc_intern(arg, word, strlen(word) + 1);
+    ALWAYS_ASSERT(first != NULL && first == again && strcmp(first, word) == 0);
+    arc_free(again, NULL);
+    arc_free(first, NULL);
+  }
+  return NULL;
+}
+
+void test_intern() {
+  arc_intern_t *table = arc_intern_new();
+  ALWAYS_ASSERT(table != NULL);
+  char *hello = arc_intern(table, "hello", 6);
+  char *world = arc_intern(table, "world", 6);
+  ALWAYS_ASSERT(hello != NULL && world != NULL && hello != world);
+  ALWAYS_ASSERT(strcmp(hello, "hello") == 0 && arc_size(hello) == 6);
+  char *again = arc_intern(table, "hello", 6);
+  ALWAYS_ASSERT(again == hello);
+  ALWAYS_ASSERT(arc_intern_find(table, "world", 6) == world);
+  arc_free(world, NULL);
+  ALWAYS_ASSERT(arc_intern_count(table) == 2);
+  // the table's weak keeps it from ever looking unique...
+  ALWAYS_ASSERT(arc_get_mut(hello) == NULL);
+  ALWAYS_ASSERT(arc_intern(table, "", 0) == NULL && errno == EINVAL);
+
+  // and its last free takes it out of the table then and there
+  arc_free(world, NULL);
+  ALWAYS_ASSERT(arc_intern_count(table) == 1);
+  ALWAYS_ASSERT(arc_intern_find(table, "world", 6) == NULL && errno == ENOENT);
+  ALWAYS_ASSERT(arc_intern_prune(table) == 0);
+
+  // plenty of keys, so the stripes have to grow
+  char *keys[1000];
+  for (int i = 0; i < 1000; ++i) {
+    keys[i] = arc_intern(table, &i, sizeof(i));
+    ALWAYS_ASSERT(keys[i] != NULL && *(int *) keys[i] == i);
+  }
+  ALWAYS_ASSERT(arc_intern_count(table) == 1001);
+  for (int i = 0; i < 1000; ++i) {
+    ALWAYS_ASSERT(arc_intern_find(table, &i, sizeof(i)) == keys[i]);
+    arc_free(keys[i], NULL);
+    arc_free(keys[i], NULL);
+  }
+  ALWAYS_ASSERT(arc_intern_count(table) == 1);
+
+  pthread_t threads[NUM_THREADS / 10];
+  for (int i = 0; i < NUM_THREADS / 10; ++i) {
+    pthread_create(&threads[i], NULL, intern_operations, table);
+  }
+  for (int i = 0; i < NUM_THREADS / 10; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  ALWAYS_ASSERT(arc_intern_count(table) == 1);
+
+  // what the table handed out outlives our ref to it
+  arc_intern_free(table);
+  ALWAYS_ASSERT(strcmp(hello, "hello") == 0);
+  arc_free(again, NULL);
+  arc_free(hello, NULL);
+}
+
+void *channel_sends(void *arg) {
+  for (int i = 0; i < NUM_OPERATIONS / 10; i += 2) {
+    int *arcs[2] = {arc_new(sizeof(int)), arc_new(sizeof(int))};
+    *arcs[0] = i;
+    *arcs[1] = i + 1;
+    // one at a time and in pairs, with whatever didn't fit tried again
+    ALWAYS_ASSERT(arc_channel_send(arg, arcs[0]) == 0);
+    size_t sent = arc_channel_send_n(arg, (void **) &arcs[1], 1);
+    ALWAYS_ASSERT(sent == 1);
+  }
+  return NULL;
+}
+
+void *channel_recvs(void *arg) {
+  void *arcs[8];
+  size_t received;
+  while ((received = arc_channel_recv_n(arg, arcs, 8)) > 0) {
+    arc_free_many(arcs, received, count_destroyed);
+  }
+  ALWAYS_ASSERT(errno == EPIPE);
+  return NULL;
+}
+
+void test_channel() {
+  atomic_store(&destroyed, 0);
+  arc_channel_t *channel = arc_channel_new(3, 0);
+  ALWAYS_ASSERT(channel != NULL);
+  int *arcs[5];
+  for (int i = 0; i < 5; ++i) {
+    arcs[i] = arc_new(sizeof(int));
+    *arcs[i] = i;
+  }
+  // rounded up to 4, and moving refs never touches the counts
+  ALWAYS_ASSERT(arc_channel_send_n(channel, (void **) arcs, 5) == 4);
+  ALWAYS_ASSERT(arc_channel_send(channel, arcs[4]) == -1 && errno == EAGAIN);
+  int *first = arc_channel_recv(channel);
+  ALWAYS_ASSERT(first == arcs[0]);
+  validate_reference_counts(__get_header(first), 1, 1);
+  ALWAYS_ASSERT(arc_channel_send(channel, arcs[4]) == 0);
+  int *rest[8];
+  ALWAYS_ASSERT(arc_channel_recv_n(channel, (void **) rest, 8) == 4);
+  for (int i = 0; i < 4; ++i) {
+    ALWAYS_ASSERT(rest[i] == arcs[i + 1] && *rest[i] == i + 1);
+  }
+  ALWAYS_ASSERT(arc_channel_recv(channel) == NULL && errno == EAGAIN);
+
+  // closed channels still drain
+  ALWAYS_ASSERT(arc_channel_send_n(channel, (void **) rest, 2) == 2);
+  arc_channel_close(channel);
+  ALWAYS_ASSERT(arc_channel_send(channel, first) == -1 && errno == EPIPE);
+  ALWAYS_ASSERT(arc_channel_recv(channel) == rest[0]);
+  // and free drops whatever is still in there
+  arc_channel_free(channel, count_destroyed);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 1);
+  arc_free_many((void **) &rest[0], 1, count_destroyed);
+  arc_free_many((void **) &rest[2], 2, count_destroyed);
+  arc_free(first, count_destroyed);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 5);
+  ALWAYS_ASSERT(arc_channel_new(0, 0) == NULL && errno == EINVAL);
+
+  // a ring far smaller than the traffic, so both ends spend time parked
+  atomic_store(&destroyed, 0);
+  channel = arc_channel_new(2, ARC_CHANNEL_BLOCKING);
+  pthread_t senders[NUM_THREADS / 20];
+  pthread_t receivers[NUM_THREADS / 20];
+  for (int i = 0; i < NUM_THREADS / 20; ++i) {
+    pthread_create(&senders[i], NULL, channel_sends, channel);
+    pthread_create(&receivers[i], NULL, channel_recvs, channel);
+  }
+  for (int i = 0; i < NUM_THREADS / 20; ++i) {
+    pthread_join(senders[i], NULL);
+  }
+  arc_channel_close(channel);
+  for (int i = 0; i < NUM_THREADS / 20; ++i) {
+    pthread_join(receivers[i], NULL);
+  }
+  ALWAYS_ASSERT(atomic_load(&destroyed) == NUM_THREADS / 20 * (NUM_OPERATIONS / 10));
+  arc_channel_free(channel, NULL);
+}
+
+void test_rc() {
+  atomic_store(&destroyed, 0);
+  int *rc = rc_new(sizeof(int));
+  ALWAYS_ASSERT(rc != NULL);
+  *rc = THE_UNIVERSE_AND_EVERYTHING;
+
+  int *weak = rc_downgrade(rc);
+  int *clone = rc_clone(rc);
+  ALWAYS_ASSERT(__rc_strong_count(__get_rc_header(rc)) == 2);
+  ALWAYS_ASSERT(__rc_weak_count(__get_rc_header(rc)) == 2);
+
+  for (int i = 0; i < NUM_OPERATIONS; ++i) {
+    int *upgraded = weak_rc_upgrade(weak);
+    ALWAYS_ASSERT(upgraded != NULL);
+    ALWAYS_ASSERT(*upgraded == THE_UNIVERSE_AND_EVERYTHING);
+    rc_free(upgraded, count_destroyed);
+    weak_rc_free(weak_rc_clone(weak));
+  }
+
+  rc_free(clone, count_destroyed);
+  rc_free(rc, count_destroyed);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 1);
+  ALWAYS_ASSERT(__rc_strong_count(__get_rc_header(weak)) == 0);
+  ALWAYS_ASSERT(weak_rc_upgrade(weak) == NULL);
+  ALWAYS_ASSERT(errno == ENOENT);
+  weak_rc_free(weak);
+}
+
+void test_batched() {
+  atomic_store(&destroyed, 0);
+  int *arc = arc_new(sizeof(int));
+  ALWAYS_ASSERT(arc_clone_n(arc, 10) == arc);
+  ALWAYS_ASSERT(weak_clone_n(arc, 5) == arc);
+  validate_reference_counts(__get_header(arc), 11, 6);
+  arc_free_n(arc, 10, count_destroyed);
+  weak_free_n(arc, 5);
+  validate_reference_counts(__get_header(arc), 1, 1);
+
+  // fan out a couple of arcs, then drop every ref in one go...
+  int *other = arc_new(sizeof(int));
+  void *refs[64];
+  for (size_t i = 0; i < 64; ++i) {
+    refs[i] = i % 3 == 0 ? other : arc;
+  }
+  arc_clone_n(arc, 41);
+  arc_clone_n(other, 21);
+  validate_reference_counts(__get_header(arc), 42, 1);
+  arc_free_many(refs, 64, count_destroyed);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 2);
+
+  // biased arcs take batches on both sides of the fence
+  int *biased = arc_new_biased(sizeof(int));
+  arc_clone_n(biased, 3);
+  arc_free_n(biased, 2, count_destroyed);
+  arc_free_n(biased, 2, count_destroyed);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 3);
+}
+
+void test_deferred() {
+  atomic_store(&destroyed, 0);
+  ALWAYS_ASSERT(arc_reclaimer_start(&(arc_reclaimer_opts_t){ARC_RECLAIM_INLINE, 0, 2}) == 0);
+  int *arc = arc_new(sizeof(int));
+  int *weak = arc_downgrade(arc_clone(arc));
+  arc_free_deferred(arc, count_destroyed);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 0);
+  // last strong going through the queue still leaves the data alive until drained
+  arc_free_deferred(arc, count_destroyed);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 0);
+  ALWAYS_ASSERT(weak_upgrade(weak) == NULL);
+  for (size_t i = 0; i < 4; ++i) {
+    arc_free_deferred(arc_new(sizeof(int)), count_destroyed);
+  }
+  // batch of 2 means the five queued take three drains
+  ALWAYS_ASSERT(arc_reclaimer_drain() == 2);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 2);
+  ALWAYS_ASSERT(arc_reclaimer_drain() == 2);
+  ALWAYS_ASSERT(arc_reclaimer_drain() == 1);
+  ALWAYS_ASSERT(arc_reclaimer_drain() == 0);
+  weak_free(weak);
+  arc_reclaimer_stop();
+
+  // a background reclaimer picks things up on its own, and stop flushes the rest
+  ALWAYS_ASSERT(arc_reclaimer_start(&(arc_reclaimer_opts_t){ARC_RECLAIM_THREAD, 100, 0}) == 0);
+  ALWAYS_ASSERT(arc_reclaimer_start(NULL) == -1 && errno == EALREADY);
+  for (size_t i = 0; i < 100; ++i) {
+    arc_free_deferred(arc_new(sizeof(int)), count_destroyed);
+  }
+  arc_reclaimer_stop();
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 105);
+}
+
+void poison_destroyed(void *data) {
+  *(int *) data = 0;
+  atomic_fetch_add(&destroyed, 1);
+}
+
+void *atomic_operations(void *arg) {
+  arc_atomic_t *cell = (arc_atomic_t *)arg;
+
+  for (int i = 0; i < NUM_OPERATIONS; ++i) {
+    int *loaded = arc_atomic_load(cell);
+    ALWAYS_ASSERT(loaded != NULL);
+    ALWAYS_ASSERT(*loaded == THE_UNIVERSE_AND_EVERYTHING);
+    arc_free(loaded, poison_destroyed);
+  }
+
+  return NULL;
+}
+
+void test_atomic() {
+  atomic_store(&destroyed, 0);
+  arc_atomic_t cell;
+  arc_atomic_init(&cell, NULL);
+  ALWAYS_ASSERT(arc_atomic_load(&cell) == NULL);
+
+  int *first = arc_new(sizeof(int));
+  *first = THE_UNIVERSE_AND_EVERYTHING;
+  arc_atomic_store(&cell, first, poison_destroyed);
+  int *loaded = arc_atomic_load(&cell);
+  ALWAYS_ASSERT(loaded == first);
+  // the slot's own ref, the strongs it keeps for pins, and ours
+  validate_reference_counts(__get_header(first), 2 + __ARC_ATOMIC_MAX_PINS, 1);
+  arc_free(loaded, poison_destroyed);
+
+  int *second = arc_new(sizeof(int));
+  *second = THE_UNIVERSE_AND_EVERYTHING;
+  ALWAYS_ASSERT(arc_atomic_compare_exchange(&cell, second, second, poison_destroyed) == 0);
+  // a failed exchange leaves desired just as it was handed in
+  validate_reference_counts(__get_header(second), 1, 1);
+  ALWAYS_ASSERT(arc_atomic_compare_exchange(&cell, first, second, poison_destroyed) == 1);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 1);
+  validate_reference_counts(__get_header(second), 1 + __ARC_ATOMIC_MAX_PINS, 1);
+
+#if !defined(ARC_OVERFLOW_ABORT) && !defined(ARC_OVERFLOW_SATURATE)
+  // an arc without room for the slot's refs never goes in...
+  int *full = arc_new(sizeof(int));
+  arc_header_t *header = __get_header(full);
+  set_strong_count(header, __ARC_WEAK_MAX_REFS - __ARC_ATOMIC_MAX_PINS + 1);
+  arc_atomic_t other;
+  errno = 0;
+  ALWAYS_ASSERT(arc_atomic_init(&other, full) == -1 && errno == ETOOMANYREFS);
+  ALWAYS_ASSERT(arc_atomic_load(&other) == NULL);
+  errno = 0;
+  ALWAYS_ASSERT(arc_atomic_store(&cell, full, NULL) == -1 && errno == ETOOMANYREFS);
+  errno = 0;
+  ALWAYS_ASSERT(arc_atomic_swap(&cell, full) == NULL && errno == ETOOMANYREFS);
+  ALWAYS_ASSERT(arc_atomic_compare_exchange(&cell, second, full, NULL) == -1);
+  ALWAYS_ASSERT(__arc_atomic_ptr(atomic_load(&cell.word)) == second);
+  ALWAYS_ASSERT(__arc_strong_count(header) == __ARC_WEAK_MAX_REFS - __ARC_ATOMIC_MAX_PINS + 1);
+  // ...and one whose count fills up in there can't be loaded back out, the
+  // pin going back all the same
+  set_strong_count(header, 1);
+  ALWAYS_ASSERT(arc_atomic_init(&other, full) == 0);
+  set_strong_count(header, __ARC_WEAK_MAX_REFS);
+  errno = 0;
+  ALWAYS_ASSERT(arc_atomic_load(&other) == NULL && errno == ETOOMANYREFS);
+  ALWAYS_ASSERT(__arc_atomic_pins(atomic_load(&other.word)) == 0);
+  set_strong_count(header, 1 + __ARC_ATOMIC_MAX_PINS);
+  ALWAYS_ASSERT(arc_atomic_store(&other, NULL, poison_destroyed) == 0);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 2);
+  atomic_store(&destroyed, 1);
+#endif
+
+#if UINTPTR_MAX > 0xFFFFFFFFu
+  // a tagged address has bits the pins live in, so it never goes in either,
+  // and nothing it points at gets touched finding that out
+  void *tagged = (void *)((uintptr_t) second | (uintptr_t) 1 << 56);
+  arc_atomic_t tagged_cell;
+  errno = 0;
+  ALWAYS_ASSERT(arc_atomic_init(&tagged_cell, tagged) == -1 && errno == EINVAL);
+  errno = 0;
+  ALWAYS_ASSERT(arc_atomic_store(&cell, tagged, NULL) == -1 && errno == EINVAL);
+  errno = 0;
+  ALWAYS_ASSERT(arc_atomic_swap(&cell, tagged) == NULL && errno == EINVAL);
+  errno = 0;
+  ALWAYS_ASSERT(arc_atomic_compare_exchange(&cell, second, tagged, NULL) == -1 && errno == EINVAL);
+  ALWAYS_ASSERT(atomic_load(&cell.word) == (uint64_t)(uintptr_t) second);
+  validate_reference_counts(__get_header(second), 1 + __ARC_ATOMIC_MAX_PINS, 1);
+#endif
+
+  // readers hammer the slot while we keep swapping fresh arcs into it
+  pthread_t threads[NUM_THREADS / 10];
+  for (int i = 0; i < NUM_THREADS / 10; ++i) {
+    pthread_create(&threads[i], NULL, atomic_operations, &cell);
+  }
+  for (int i = 0; i < NUM_OPERATIONS; ++i) {
+    int *next = arc_new(sizeof(int));
+    *next = THE_UNIVERSE_AND_EVERYTHING;
+    int *old = arc_atomic_swap(&cell, next);
+    ALWAYS_ASSERT(old != NULL && *old == THE_UNIVERSE_AND_EVERYTHING);
+    arc_free(old, poison_destroyed);
+  }
+  for (int i = 0; i < NUM_THREADS / 10; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  arc_atomic_store(&cell, NULL, poison_destroyed);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == NUM_OPERATIONS + 2);
+}
+
+void *borrow_operations(void *arg) {
+  arc_atomic_t *cell = (arc_atomic_t *)arg;
+
+  for (int i = 0; i < NUM_OPERATIONS; ++i) {
+    ALWAYS_ASSERT(arc_borrow_begin() == 0);
+    int *borrowed = arc_atomic_borrow(cell);
+    ALWAYS_ASSERT(borrowed != NULL);
+    // no ref of our own, yet poisoning has to wait for us
+    ALWAYS_ASSERT(*borrowed == THE_UNIVERSE_AND_EVERYTHING);
+    arc_borrow_end();
+  }
+
+  return NULL;
+}
+
+void *borrow_drop(void *arg) {
+  arc_free(arg, poison_destroyed);
+  return NULL;
+}
+
+void test_borrow() {
+  atomic_store(&destroyed, 0);
+  int *arc = arc_new(sizeof(int));
+  *arc = THE_UNIVERSE_AND_EVERYTHING;
+  ALWAYS_ASSERT(arc_borrow_begin() == 0);
+  // from here on last drops pay for their fence
+  ALWAYS_ASSERT(atomic_load(&__arc_borrowed) == 1);
+  ALWAYS_ASSERT(arc_borrow_begin() == 0);
+  arc_free(arc, poison_destroyed);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 0 && *arc == THE_UNIVERSE_AND_EVERYTHING);
+  ALWAYS_ASSERT(arc_borrow_collect() == 0);
+  arc_borrow_end();
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 0);
+  // the outermost guard going is what lets it go
+  arc_borrow_end();
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 1);
+
+  // drops left behind by a thread that exits mid guard get adopted
+  ALWAYS_ASSERT(arc_borrow_begin() == 0);
+  pthread_t thread;
+  pthread_create(&thread, NULL, borrow_drop, arc_new(sizeof(int)));
+  pthread_join(thread, NULL);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 1);
+  arc_borrow_end();
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 2);
+
+  // with nobody borrowing, last drops go right away as ever
+  arc_free(arc_new(sizeof(int)), poison_destroyed);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 3);
+
+  // unwrapping and moving give the old block up like any last drop would
+  counting_allocator_t counts = {0, 0};
+  arc_allocator_t allocator = {counting_alloc, counting_free, &counts, NULL};
+  int *unwrapped = arc_new_in(&allocator, sizeof(int));
+  *unwrapped = THE_UNIVERSE_AND_EVERYTHING;
+  int *moving = arc_new_in(&allocator, sizeof(int));
+  *moving = THE_UNIVERSE_AND_EVERYTHING;
+  ALWAYS_ASSERT(arc_borrow_begin() == 0);
+  int out = 0;
+  ALWAYS_ASSERT(arc_try_unwrap(unwrapped, &out, 0) == 0 && out == THE_UNIVERSE_AND_EVERYTHING);
+  int *moved = arc_realloc(moving, 1024);
+  ALWAYS_ASSERT(moved != NULL && moved != moving && *moved == THE_UNIVERSE_AND_EVERYTHING);
+  ALWAYS_ASSERT(counts.allocs == 3 && counts.frees == 0);
+  ALWAYS_ASSERT(*unwrapped == THE_UNIVERSE_AND_EVERYTHING && *moving == THE_UNIVERSE_AND_EVERYTHING);
+  // and without a recorded size (or a pool slab to tell) there's nothing
+  // to copy by
+  int *plain = arc_new(256);
+  ALWAYS_ASSERT(arc_realloc(plain, 1024) == NULL && errno == EBUSY);
+  arc_borrow_end();
+  ALWAYS_ASSERT(counts.frees == 2);
+  arc_free(moved, NULL);
+  ALWAYS_ASSERT(counts.frees == 3);
+  plain = arc_realloc(plain, 1024);
+  ALWAYS_ASSERT(plain != NULL);
+  arc_free(plain, NULL);
+
+  atomic_store(&destroyed, 0);
+  arc_atomic_t cell;
+  int *first = arc_new(sizeof(int));
+  *first = THE_UNIVERSE_AND_EVERYTHING;
+  arc_atomic_init(&cell, first);
+  pthread_t threads[NUM_THREADS / 10];
+  for (int i = 0; i < NUM_THREADS / 10; ++i) {
+    pthread_create(&threads[i], NULL, borrow_operations, &cell);
+  }
+  for (int i = 0; i < NUM_OPERATIONS; ++i) {
+    int *next = arc_new(sizeof(int));
+    *next = THE_UNIVERSE_AND_EVERYTHING;
+    arc_atomic_store(&cell, next, poison_destroyed);
+  }
+  for (int i = 0; i < NUM_THREADS / 10; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  arc_atomic_store(&cell, NULL, poison_destroyed);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == NUM_OPERATIONS + 1);
+}
+
+void test_immortal() {
+  atomic_store(&destroyed, 0);
+  // never freed, so it had better stay reachable like any singleton would
+  static int *arc;
+  arc = arc_new(sizeof(int));
+  *arc = THE_UNIVERSE_AND_EVERYTHING;
+  ALWAYS_ASSERT(!arc_is_immortal(arc));
+  ALWAYS_ASSERT(arc_make_immortal(arc) == arc && arc_is_immortal(arc));
+  arc_header_t *header = __get_header(arc);
+  validate_reference_counts(header, __ARC_STICKY_REFS, __ARC_STICKY_REFS);
+
+  // nothing moves the counts anymore, however much anybody clones or frees
+  test_data_t data = {arc, arc_downgrade(arc)};
+  pthread_t threads[NUM_THREADS / 10];
+  for (int i = 0; i < NUM_THREADS / 10; ++i) {
+    pthread_create(&threads[i], NULL, i % 2 ? arc_operations : weak_operations, &data);
+  }
+  for (int i = 0; i < NUM_THREADS / 10; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  validate_reference_counts(header, __ARC_STICKY_REFS, __ARC_STICKY_REFS);
+  ALWAYS_ASSERT(arc_clone_n(arc, SIZE_MAX) == arc);
+  ALWAYS_ASSERT(weak_clone_n(arc, SIZE_MAX) == arc);
+  ALWAYS_ASSERT(arc_get_mut(arc) == NULL);
+  for (int i = 0; i < 10; ++i) {
+    arc_free(arc, poison_destroyed);
+    weak_free(arc);
+  }
+  arc_free_n(arc, SIZE_MAX, poison_destroyed);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 0 && *arc == THE_UNIVERSE_AND_EVERYTHING);
+  validate_reference_counts(header, __ARC_STICKY_REFS, __ARC_STICKY_REFS);
+
+  int *biased = arc_new_biased(sizeof(int));
+  ALWAYS_ASSERT(arc_make_immortal(biased) == NULL && errno == EINVAL);
+  arc_free(biased, NULL);
+}
+
+typedef struct cycle_node {
+  // strong refs to other traced nodes, or NULL
+  struct cycle_node *children[2];
+} cycle_node_t;
+
+// a node that gets cloned and freed every time the collector traces it
+cycle_node_t *churned;
+
+void cycle_trace(void *arc_data, arc_visit_fn visit, void *ctx) {
+  cycle_node_t *node = arc_data;
+  if (node == churned) {
+    arc_free(arc_clone(node), NULL);
+  }
+  for (int i = 0; i < 2; ++i) {
+    if (node->children[i] != NULL) {
+      visit(node->children[i], ctx);
+    }
+  }
+}
+
+void cycle_destroy(void *arc_data) {
+  cycle_node_t *node = arc_data;
+  for (int i = 0; i < 2; ++i) {
+    if (node->children[i] != NULL) {
+      arc_free(node->children[i], NULL);
+    }
+  }
+  atomic_fetch_add(&destroyed, 1);
+}
+
+cycle_node_t *cycle_node_new(void) {
+  cycle_node_t *node = arc_new_traced(sizeof(cycle_node_t), cycle_trace, cycle_destroy);
+  ALWAYS_ASSERT(node != NULL);
+  node->children[0] = node->children[1] = NULL;
+  return node;
+}
+
+// a <-> b, handing back our strong to a
+cycle_node_t *cycle_pair_new(void) {
+  cycle_node_t *a = cycle_node_new();
+  cycle_node_t *b = cycle_node_new();
+  a->children[0] = arc_clone(b);
+  b->children[0] = arc_clone(a);
+  arc_free(b, NULL);
+  return a;
+}
+
+void *cycle_operations(void *arg) {
+  for (int i = 0; i < NUM_OPERATIONS; ++i) {
+    arc_free(arc_clone(arg), NULL);
+  }
+  return NULL;
+}
+
+void test_cycles() {
+  atomic_store(&destroyed, 0);
+  cycle_node_t *self = cycle_node_new();
+  self->children[0] = arc_clone(self);
+  ALWAYS_ASSERT(arc_downgrade(self) == NULL && errno == EINVAL);
+  ALWAYS_ASSERT(arc_make_immortal(self) == NULL && errno == EINVAL);
+  arc_free(self, NULL);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 0);
+  ALWAYS_ASSERT(arc_collect_cycles(0) == 1 && atomic_load(&destroyed) == 1);
+  ALWAYS_ASSERT(arc_collect_cycles(0) == 0);
+
+  // anything held from outside stays, along with everything it reaches
+  atomic_store(&destroyed, 0);
+  cycle_node_t *pair = cycle_pair_new();
+  cycle_node_t *tail = cycle_node_new();
+  pair->children[0]->children[1] = tail;
+  ALWAYS_ASSERT(arc_collect_cycles(0) == 0 && atomic_load(&destroyed) == 0);
+  ALWAYS_ASSERT(arc_get_mut(tail) == tail);
+  arc_free(pair, NULL);
+  ALWAYS_ASSERT(arc_collect_cycles(0) == 3 && atomic_load(&destroyed) == 3);
+
+  // no cycle, no collection... the last free goes the usual way
+  atomic_store(&destroyed, 0);
+  cycle_node_t *plain = cycle_node_new();
+  arc_free(arc_clone_n(plain, 3), NULL);
+  ALWAYS_ASSERT(arc_get_mut(plain) == NULL);
+  ALWAYS_ASSERT(arc_collect_cycles(0) == 0 && atomic_load(&destroyed) == 0);
+  arc_free_n(plain, 2, NULL);
+  ALWAYS_ASSERT(arc_get_mut(plain) == NULL);
+  ALWAYS_ASSERT(arc_collect_cycles(0) == 0 && arc_get_mut(plain) == plain);
+  arc_free(plain, NULL);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == 1);
+
+  // a budget only looks at that many candidates at a time
+  atomic_store(&destroyed, 0);
+  for (int i = 0; i < 3; ++i) {
+    arc_free(cycle_pair_new(), NULL);
+  }
+  ALWAYS_ASSERT(arc_collect_cycles(1) == 2);
+  ALWAYS_ASSERT(arc_collect_cycles(0) == 4 && atomic_load(&destroyed) == 6);
+
+  // a cycle that keeps moving under the collector doesn't stop the ones next
+  // to it going, and gets left for next time once it's out of goes
+  atomic_store(&destroyed, 0);
+  churned = cycle_pair_new();
+  arc_free(cycle_pair_new(), NULL);
+  arc_free(churned, NULL);
+  ALWAYS_ASSERT(arc_collect_cycles(0) == 2 && atomic_load(&destroyed) == 2);
+  ALWAYS_ASSERT(arc_collect_cycles(0) == 0 && atomic_load(&destroyed) == 2);
+  churned = NULL;
+  ALWAYS_ASSERT(arc_collect_cycles(0) == 2 && atomic_load(&destroyed) == 4);
+
+  // a cycle others keep cloning and freeing from outside never goes while
+  // the collector thread keeps looking at it
+  atomic_store(&destroyed, 0);
+  ALWAYS_ASSERT(arc_collector_start(100, 0) == 0);
+  ALWAYS_ASSERT(arc_collector_start(100, 0) == -1 && errno == EALREADY);
+  pair = cycle_pair_new();
+  pthread_t threads[NUM_THREADS / 10];
+  for (int i = 0; i < NUM_THREADS / 10; ++i) {
+    pthread_create(&threads[i], NULL, cycle_operations, pair);
+  }
+  for (int i = 0; i < NUM_OPERATIONS / 10; ++i) {
+    arc_free(cycle_pair_new(), NULL);
+  }
+  for (int i = 0; i < NUM_THREADS / 10; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  ALWAYS_ASSERT(pair->children[0]->children[0] == pair);
+  arc_free(pair, NULL);
+  // and what's left behind goes without anyone asking
+  for (int i = 0; i < 10000 && atomic_load(&destroyed) < NUM_OPERATIONS / 5 + 2; ++i) {
+    usleep(1000);
+  }
+  arc_collector_stop();
+  arc_collect_cycles(0);
+  ALWAYS_ASSERT(atomic_load(&destroyed) == NUM_OPERATIONS / 5 + 2);
+}
+
+// only the first guard in a process signs it up, so this has to run in a
+// child of one that hasn't borrowed yet
+void test_borrow_fallback() {
+  pid_t child = fork();
+  if (child == 0) {
+    membarrier_broken = 1;
+#ifndef ARC_BORROW_FENCE
+    // no membarrier at load, and last drops fence from the start
+    atomic_store(&__arc_borrowed, 0);
+    __arc_borrow_probe();
+    ALWAYS_ASSERT(atomic_load(&__arc_borrowed) == 1);
+    atomic_store(&__arc_borrowed, 0);
+#endif // ARC_BORROW_FENCE
+    // nor once the first guard turns up, which still gets its guard
+    atomic_store(&destroyed, 0);
+    int *arc = arc_new(sizeof(int));
+    ALWAYS_ASSERT(arc_borrow_begin() == 0);
+    ALWAYS_ASSERT(atomic_load(&__arc_borrowed) == 1);
+    arc_free(arc, count_destroyed);
+    ALWAYS_ASSERT(atomic_load(&destroyed) == 0);
+    arc_borrow_end();
+    ALWAYS_ASSERT(atomic_load(&destroyed) == 1);
+    // and so does the collector
+    cycle_node_t *self = cycle_node_new();
+    self->children[0] = arc_clone(self);
+    arc_free(self, NULL);
+    ALWAYS_ASSERT(arc_collect_cycles(0) == 1 && atomic_load(&destroyed) == 2);
+    _exit(0);
+  }
+  int status;
+  waitpid(child, &status, 0);
+  ALWAYS_ASSERT(WIFEXITED(status) && WEXITSTATUS(status) == 0);
+}
+
+void test_overflow() {
+#if defined(ARC_COMPACT_COUNTS) || defined(ARC_PACKED_COUNTS)
+  ALWAYS_ASSERT(sizeof(arc_header_t) == 8 && __ARC_HEADER_SIZE_WITH_PAD == 8 && __ARC_WEAK_MAX_REFS == UINT32_MAX >> 2);
+#endif // ARC_COMPACT_COUNTS || ARC_PACKED_COUNTS
+  int *arc = arc_new(sizeof(int));
+  ALWAYS_ASSERT(arc != NULL);
+  arc_header_t *header = __get_header(arc);
+  set_strong_count(header, __ARC_WEAK_MAX_REFS);
+#if defined(ARC_OVERFLOW_ABORT)
+  pid_t child = fork();
+  if (child == 0) {
+    arc_clone(arc);
+    _exit(0);
+  }
+  int status;
+  waitpid(child, &status, 0);
+  ALWAYS_ASSERT(WIFSIGNALED(status) && WTERMSIG(status) == SIGABRT);
+#elif defined(ARC_OVERFLOW_SATURATE)
+  // past the max the count sticks, and nothing brings it back down...
+  ALWAYS_ASSERT(arc_clone(arc) == arc);
+  ALWAYS_ASSERT(__arc_strong_count(header) == __ARC_STICKY_REFS);
+  for (int i = 0; i < NUM_OPERATIONS; ++i) {
+    ALWAYS_ASSERT(arc_clone(arc) == arc);
+    arc_free(arc, NULL);
+    arc_free(arc, NULL);
+  }
+  ALWAYS_ASSERT(__arc_strong_count(header) == __ARC_STICKY_REFS);
+  ALWAYS_ASSERT(weak_upgrade(arc) == arc);
+  // leaked on purpose, so the test ends here
+  return;
+#else
+  errno = 0;
+  ALWAYS_ASSERT(arc_clone(arc) == NULL);
+  ALWAYS_ASSERT(errno == ETOOMANYREFS);
+#endif
+  set_strong_count(header, 1);
+  arc_free(arc, NULL);
+}
+
+void test_stats() {
+  arc_stats_t before;
+#ifndef ARC_STATS
+  ALWAYS_ASSERT(arc_stats_snapshot(&before) == -1 && errno == ENOTSUP);
+  ALWAYS_ASSERT(before.allocations == 0);
+#else
+  arc_stats_t after;
+  ALWAYS_ASSERT(arc_stats_snapshot(&before) == 0);
+  int *arc = arc_new(100);
+  *arc = THE_UNIVERSE_AND_EVERYTHING;
+  ALWAYS_ASSERT(arc_stats_snapshot(&after) == 0);
+  ALWAYS_ASSERT(after.allocations == before.allocations + 1);
+  ALWAYS_ASSERT(after.live_bytes == before.live_bytes + 100);
+
+  // threads that have since exited still count...
+  pthread_t threads[NUM_THREADS];
+  test_data_t data = {arc, NULL};
+  for (size_t i = 0; i < NUM_THREADS; ++i) {
+    pthread_create(&threads[i], NULL, arc_operations, &data);
+  }
+  for (size_t i = 0; i < NUM_THREADS; ++i) {
+    pthread_join(threads[i], NULL);
+  }
+  int *weak = arc_downgrade(arc);
+  ALWAYS_ASSERT(arc_realloc(arc, 200) == NULL && errno == EBUSY);
+  ALWAYS_ASSERT(arc_stats_snapshot(&after) == 0);
+  ALWAYS_ASSERT(after.clones - before.clones == NUM_THREADS * NUM_OPERATIONS);
+  ALWAYS_ASSERT(after.downgrades - before.downgrades == NUM_THREADS * NUM_OPERATIONS + 1);
+  ALWAYS_ASSERT(after.upgrades - before.upgrades == NUM_THREADS * NUM_OPERATIONS);
+  ALWAYS_ASSERT(after.upgrade_failures == before.upgrade_failures);
+  ALWAYS_ASSERT(after.live_bytes == before.live_bytes + 100);
+
+  // the count goes away with the last weak, not the last strong
+  arc_free(arc, NULL);
+  ALWAYS_ASSERT(weak_upgrade(weak) == NULL);
+  ALWAYS_ASSERT(arc_stats_snapshot(&after) == 0);
+  ALWAYS_ASSERT(after.upgrade_failures == before.upgrade_failures + 1);
+  ALWAYS_ASSERT(after.frees == before.frees);
+  weak_free(weak);
+
+  // and a realloc swaps the bytes over
+  arc = arc_new(100);
+  arc = arc_realloc(arc, 300);
+  ALWAYS_ASSERT(arc != NULL);
+  ALWAYS_ASSERT(arc_stats_snapshot(&after) == 0);
+  ALWAYS_ASSERT(after.live_bytes == before.live_bytes + 300);
+  arc_free(arc, NULL);
+  ALWAYS_ASSERT(arc_stats_snapshot(&after) == 0);
+  ALWAYS_ASSERT(after.allocations - before.allocations == 2);
+  ALWAYS_ASSERT(after.frees - before.frees == 2);
+  ALWAYS_ASSERT(after.live_bytes == before.live_bytes);
+
+  // rcs get counts of their own, and stay out of the arcs'
+  int *rc = rc_new(50);
+  ALWAYS_ASSERT(arc_stats_snapshot(&after) == 0);
+  ALWAYS_ASSERT(after.rc_allocations == before.rc_allocations + 1);
+  ALWAYS_ASSERT(after.rc_live_bytes == before.rc_live_bytes + 50);
+  ALWAYS_ASSERT(after.allocations - before.allocations == 2);
+  ALWAYS_ASSERT(after.live_bytes == before.live_bytes);
+  rc_free(rc, NULL);
+  ALWAYS_ASSERT(arc_stats_snapshot(&after) == 0);
+  ALWAYS_ASSERT(after.rc_frees == before.rc_frees + 1);
+  ALWAYS_ASSERT(after.rc_live_bytes == before.rc_live_bytes);
+  ALWAYS_ASSERT(after.frees - before.frees == 2);
+#endif // ARC_STATS
+}
+
+void test_sampling() {
+  arc_sample_t samples[8];
+#ifndef ARC_SAMPLING
+  ALWAYS_ASSERT(arc_sample_every(1) == -1 && errno == ENOTSUP);
+  ALWAYS_ASSERT(arc_sample_dump(samples, 8) == 0);
+#else
+  ALWAYS_ASSERT(arc_sample_dump(samples, 8) == 0);
+  // every other allocation, so only first and third get picked...
+  ALWAYS_ASSERT(arc_sample_every(2) == 0);
+  int *skipped = arc_new(sizeof(int));
+  int *first = arc_new(sizeof(int));
+  int *missed = arc_new(sizeof(int));
+  int *second = arc_new_with_dtor(64, NULL);
+  ALWAYS_ASSERT(arc_sample_every(0) == 0);
+  arc_free(arc_new(sizeof(int)), NULL);
+  arc_free(first, NULL);
+
+  // counts are gone but the sample outlives them, now with a lifetime
+  ALWAYS_ASSERT(arc_sample_dump(samples, 8) == 2);
+  for (size_t i = 0; i < 2; ++i) {
+    ALWAYS_ASSERT(samples[i].arc_data == first || samples[i].arc_data == second);
+    ALWAYS_ASSERT(samples[i].depth > 0);
+    ALWAYS_ASSERT(samples[i].live == (samples[i].arc_data == second));
+    ALWAYS_ASSERT(samples[i].nbytes == (samples[i].arc_data == second ? 64u : sizeof(int)));
+  }
+  ALWAYS_ASSERT(arc_sample_dump(samples, 1) == 1);
+  arc_free(skipped, NULL);
+  arc_free(missed, NULL);
+  arc_free(second, NULL);
+#endif // ARC_SAMPLING
+}
+
+#ifdef ARC_POOL
+
+#define NUM_POOLED 4000
+
+void *free_pooled(void *arg) {
+  int **arcs = arg;
+  for (size_t i = 0; i < NUM_POOLED; ++i) {
+    arc_free(arcs[i], NULL);
+  }
+  return NULL;
+}
+
+size_t count_slabs(size_t block_size) {
+  size_t slabs = 0;
+  arc_pool_slab_t *slab = __arc_pool_heap[block_size / __ARC_POOL_GRAIN - 1].slabs;
+  for (; slab != NULL; slab = slab->next) {
+    ++slabs;
+  }
+  return slabs;
+}
+
+// churns through a slab's worth and exits with one arc still out there...
+void *pool_orphan(void *arg) {
+  for (int i = 0; i < NUM_POOLED; ++i) {
+    arc_free(arc_new(sizeof(int)), NULL);
+  }
+  *(int **) arg = arc_new(sizeof(int));
+  return NULL;
+}
+
+void test_pool() {
+  static int *arcs[NUM_POOLED];
+  for (int round = 0; round < 4; ++round) {
+    for (size_t i = 0; i < NUM_POOLED; ++i) {
+      arcs[i] = arc_new(sizeof(int));
+      ALWAYS_ASSERT(arcs[i] != NULL);
+      ALWAYS_ASSERT(__arc_flags(__get_header(arcs[i])) & __ARC_FLAG_POOL);
+      *arcs[i] = THE_UNIVERSE_AND_EVERYTHING;
+    }
+    // hand everything back from another thread, forcing the remote path...
+    pthread_t thread;
+    pthread_create(&thread, NULL, free_pooled, arcs);
+    pthread_join(thread, NULL);
+  }
+  // remote frees were picked back up, so we never grew past the first rounds
+  size_t block_size = __ARC_HEADER_SIZE_WITH_PAD + sizeof(int);
+  block_size = (block_size + __ARC_POOL_GRAIN - 1) & ~(__ARC_POOL_GRAIN - 1);
+  size_t per_slab = (ARC_POOL_SLAB_SIZE - __ARC_POOL_SLAB_HEADER_SIZE) / block_size;
+  ALWAYS_ASSERT(count_slabs(block_size) <= NUM_POOLED / per_slab + 2);
+
+  // an exiting thread keeps only the slabs it still has blocks out in, and
+  // those go with their last block
+  int *orphan = NULL;
+  pthread_t thread;
+  pthread_create(&thread, NULL, pool_orphan, &orphan);
+  pthread_join(thread, NULL);
+  ALWAYS_ASSERT(orphan != NULL && (__arc_flags(__get_header(orphan)) & __ARC_FLAG_POOL));
+  arc_pool_slab_t *slab = __arc_pool_slab_of(__get_header(orphan));
+  ALWAYS_ASSERT(atomic_load(&slab->remote) == &__arc_pool_orphan);
+  ALWAYS_ASSERT(atomic_load(&slab->orphaned) == 1);
+  arc_free(orphan, NULL);
+
+  // big arcs still go to malloc
+  uint8_t *big = arc_new(ARC_POOL_MAX_BLOCK);
+  ALWAYS_ASSERT(big != NULL);
+  ALWAYS_ASSERT(!(__arc_flags(__get_header(big)) & __ARC_FLAG_POOL));
+  arc_free(big, NULL);
+}
+
+#endif // ARC_POOL
+
 int main(int argc, char *argv[]) {
   (void) argc;
   (void) argv;
 
   printf("Running tests...\n");
   
+  test_borrow_fallback();
   test_arc();
+  test_allocator();
+  test_aligned();
+  test_with_dtor();
+  test_constructors();
+  test_mapped();
+  test_numa();
+  test_get_mut();
+  test_unwrap();
+  test_intrusive();
+  test_shm();
+  test_bytes();
+  test_biased();
+  test_sharded();
+  test_intern();
+  test_channel();
+  test_rc();
+  test_batched();
+  test_deferred();
+  test_atomic();
+  test_borrow();
+  test_immortal();
+  test_cycles();
+  test_overflow();
+  test_stats();
+  test_sampling();
+#ifdef ARC_POOL
+  test_pool();
+#endif // ARC_POOL
 
   printf("All tests passing...\n");
   return 0;